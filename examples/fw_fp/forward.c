@@ -175,7 +175,7 @@ packet_handler(struct rte_mbuf* pkt, struct onvm_pkt_meta* meta) {
 		uint32_t hash_fid;
 		unsigned int temp = firewall_blk(pkt, blacklist, BLACKLIST_LENGTH);
 		temp ++;
-		hash_fid = NF_Get_FID_NOFP(pkt);
+		hash_fid = NF_Get_FID(pkt);
 		LMAT[0] = hash_fid;
 		LMAT[1] = -1;//Action_Type, No Pkt Drop
 		LMAT[2] = 0;//Action_Field
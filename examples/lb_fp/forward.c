@@ -248,7 +248,7 @@ packet_handler(struct rte_mbuf* pkt, struct onvm_pkt_meta* meta) {
                 do_stats_display(pkt);
                 counter = 0;
         }
-		unsigned int hash_fid = NF_Get_FID_NOFP(pkt)%10000;
+		unsigned int hash_fid = NF_Get_FID(pkt);
 		LMAT[0] = hash_fid;
 
 		nf_result result;
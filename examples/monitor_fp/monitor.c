@@ -61,7 +61,7 @@
 
 /* Struct that contains information about this NF */
 struct onvm_nf_info *nf_info;
-int statis[100000][1];
+int statis[NUM_OF_FLOW][1];
 struct onvm_nf_LMAT *onvm_nf_LMAT;
 
 /* number of package between each print */
@@ -158,6 +158,13 @@ callback_handler(void) {
         return 0;
 }
 
+/* The manager evicted the flow, its FID may come back for a new one */
+static void
+teardown_handler(uint32_t fid) {
+        if (fid < NUM_OF_FLOW)
+                statis[fid][0] = 0;
+}
+
 static int*
 packet_handler(struct rte_mbuf* pkt, struct onvm_pkt_meta* meta) {
         int *LMAT = (int *)malloc(7*sizeof(int));
@@ -167,10 +174,11 @@ packet_handler(struct rte_mbuf* pkt, struct onvm_pkt_meta* meta) {
                 do_stats_display(pkt);
                 counter = 0;
         }
-		unsigned int hash_fid = NF_Get_FID_NOFP(pkt);
-		statis[hash_fid][0] ++;
+		unsigned int hash_fid = NF_Get_FID(pkt);
+		if (hash_fid < NUM_OF_FLOW)
+			statis[hash_fid][0] ++;
 		LMAT[0] = hash_fid;
-		printf("Flow Id: %u, Flow Pkt Num: %d\n", hash_fid, statis[hash_fid][0]);
+		printf("Flow Id: %u, Flow Pkt Num: %d\n", hash_fid, hash_fid < NUM_OF_FLOW ? statis[hash_fid][0] : 0);
 		LMAT[1] = -1;//Action_Type, No Pkt Drop
 		LMAT[2] = 0;//Action_Field
 		LMAT[3] = 0;
@@ -205,6 +213,7 @@ int main(int argc, char *argv[]) {
         cur_cycles = rte_get_tsc_cycles();
         last_cycle = rte_get_tsc_cycles();
 
+        onvm_nflib_set_teardown_handler(&teardown_handler);
         onvm_nflib_run_callback(nf_info, &packet_handler, &callback_handler);
         printf("If we reach here, program is ending\n");
         return 0;
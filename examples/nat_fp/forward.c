@@ -183,7 +183,7 @@ packet_handler(struct rte_mbuf* pkt, struct onvm_pkt_meta* meta) {
 		result = nat(pkt,acl);
 		
 		int hash_fid;
-		hash_fid = NF_Get_FID_NOFP(pkt);	
+		hash_fid = NF_Get_FID(pkt);	
 		
 		LMAT[0] = hash_fid;
 		if(result.flag == 0)
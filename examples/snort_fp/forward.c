@@ -1846,7 +1846,7 @@ packet_handler(struct rte_mbuf* pkt, struct onvm_pkt_meta* meta) {
         meta->destination = 1;
 		snort_state_action(pkt);
 		uint32_t hash_fid;
-		hash_fid = NF_Get_FID_NOFP(pkt);	
+		hash_fid = NF_Get_FID(pkt);	
 		LMAT[0] = hash_fid;
 		LMAT[1] = -1;//Action_Type
 		LMAT[2] = 0;//Action_Field
@@ -1,7 +1,7 @@
 #!/bin/bash
 
 function usage {
-        echo "$0 CPU-LIST PORTMASK [-r NUM-SERVICES] [-d DEFAULT-SERVICE] [-s STATS-OUTPUT] [-p WEB-PORT-NUMBER] [-z STATS-SLEEP-TIME]"
+        echo "$0 CPU-LIST PORTMASK [-r NUM-SERVICES] [-d DEFAULT-SERVICE] [-s STATS-OUTPUT] [-p WEB-PORT-NUMBER] [-z STATS-SLEEP-TIME] [-c] [-q RX-THREADS] [-t TCP-TIMEOUT] [-u UDP-TIMEOUT] [-o OTHER-TIMEOUT] [-w SA-WORKERS] [-S SNAPSHOT-FILE] [-k SNAPSHOT-INTERVAL] [-x] [-a ACTION-CORES] [-b]"
         # this works well on our 2x6-core nodes
         echo "$0 0,1,2,6 3 --> cores 0, 1, 2 and 6 with ports 0 and 1"
         echo -e "\tCores will be used as follows in numerical order:"
@@ -14,6 +14,20 @@ function usage {
         echo -e "\tRuns ONVM the same way as above, but prints statistics to stdout"
         echo -e "$0 0,1,2,6 3 -r 10 -d 2"
         echo -e "\tRuns ONVM the same way as above, but limits max service IDs to 10 and uses service ID 2 as the default"
+        echo -e "$0 0,1,2,3,6 3 -c"
+        echo -e "\tRuns ONVM the same way as above, but moves LMAT consolidation to a dedicated control core"
+        echo -e "$0 0,1,2,3,4,6 3 -q 2"
+        echo -e "\tRuns ONVM with 2 RX threads, NIC RSS spreads flows over their queues"
+        echo -e "$0 0,1,2,3,4,6 3 -w 2"
+        echo -e "\tRuns ONVM with 2 cores running the NFs' state actions off the RX core"
+        echo -e "$0 0,1,2,6 3 -S /var/run/onvm_gmat.snap"
+        echo -e "\tRuns ONVM the same way as above, but keeps the fast path flows across a restart"
+        echo -e "$0 0,1,2,6 3 -x"
+        echo -e "\tRuns ONVM the same way as above, but the RX core sends fast path packets to the NIC itself"
+        echo -e "$0 0,1,2,3,4,6 3 -a 2"
+        echo -e "\tRuns ONVM with the RX core only classifying and 2 cores running the fast path actions"
+        echo -e "$0 0,1,2,3,4,6 3 -q 2 -b"
+        echo -e "\tRuns ONVM with 2 RX threads, an idle one runs fast path flows of the other when it falls behind"
         exit 1
 }
 
@@ -30,7 +44,7 @@ then
     usage
 fi
 
-while getopts "v:r:d:s:p:z:" opt; do
+while getopts "v:r:d:s:p:z:cq:t:u:o:w:S:k:xa:b" opt; do
     case $opt in
         v) virt_addr="--base-virtaddr=$OPTARG";;
         r) num_srvc="-r $OPTARG";;
@@ -38,6 +52,17 @@ while getopts "v:r:d:s:p:z:" opt; do
         s) stats="-s $OPTARG";;
         p) web_port="$OPTARG";;
         z) stats_sleep_time="-z $OPTARG";;
+        c) ctrl_core="-c";;
+        q) rx_threads="-q $OPTARG";;
+        t) tcp_timeout="-t $OPTARG";;
+        u) udp_timeout="-u $OPTARG";;
+        o) other_timeout="-o $OPTARG";;
+        w) sa_workers="-w $OPTARG";;
+        S) snapshot="-S $OPTARG";;
+        k) snapshot_interval="-k $OPTARG";;
+        x) direct_tx="-x";;
+        a) action_cores="-a $OPTARG";;
+        b) steal="-b";;
         \?) echo "Unknown option -$OPTARG" && usage
             ;;
     esac
@@ -59,7 +84,7 @@ fi
 
 sudo rm -rf /mnt/huge/rtemap_*
 #manager test / 2017.10.30 21:08 FM
-sudo $SCRIPTPATH/onvm_mgr/onvm_mgr/$RTE_TARGET/onvm_mgr -l $cpu -n 4 --proc-type=primary ${virt_addr} -- -p ${ports} ${num_srvc} ${def_srvc} ${stats} ${stats_sleep_time}
+sudo $SCRIPTPATH/onvm_mgr/onvm_mgr/$RTE_TARGET/onvm_mgr -l $cpu -n 4 --proc-type=primary ${virt_addr} -- -p ${ports} ${num_srvc} ${def_srvc} ${stats} ${stats_sleep_time} ${ctrl_core} ${rx_threads} ${tcp_timeout} ${udp_timeout} ${other_timeout} ${sa_workers} ${snapshot} ${snapshot_interval} ${direct_tx} ${action_cores} ${steal}
 #sudo /home/nfv/openNetVM/onvm/onvm_mgr/build/onvm_mgr -l $cpu -n 4 --proc-type=primary ${virt_addr} -- -p ${ports} ${num_srvc} ${def_srvc} ${stats} ${stats_sleep_time}
 if [ "${stats}" = "-s web" ]
 then
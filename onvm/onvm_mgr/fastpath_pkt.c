@@ -6,6 +6,13 @@
 #include "onvm_common.h"
 #include "fastpath_pkt.h"
 #include <inttypes.h>
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include <rte_branch_prediction.h>
 #include <rte_mbuf.h>
@@ -16,13 +23,35 @@
 #include <rte_tcp.h>
 #include <rte_udp.h>
 
-extern MAT_Map LMAT[NUM_OF_NF][NUM_OF_FLOW], GMAT[NUM_OF_FLOW];
+extern uint32_t OP_LMAT_bef_cons[NUM_OF_FLOW];
+extern uint32_t FP_LMAT_bef_cons[NUM_OF_FLOW];
+struct onvm_ft *GMAT[ONVM_MAX_RX_THREADS];
+FP_Flow_Ctr *GMAT_ctr_shard[ONVM_MAX_RX_THREADS];
+FP_Cycle_Stats fp_cycle_stats[RTE_MAX_LCORE];
+struct onvm_tunnel_table *fp_tunnels;
+uint8_t fp_csum_offload;
+uint32_t GMAT_shard_bits;
+struct lmat_chain lmat_chain;
 extern URT_Map URT[NUM_OF_FLOW];
-int flag_PA = -1; //记录最后Consolidation的PA是modify还是drop
 int state_val = 0;
-extern int hash_fid;
-extern pthread_t thread[NUM_OF_NF]; //threads
-void * thread_return[NUM_OF_NF];
+extern pthread_t thread[FP_MAX_CHAIN]; //threads
+static struct rte_mempool *sa_job_pool;
+static struct rte_ring *sa_ring[ONVM_MAX_RX_THREADS][ONVM_MAX_SA_WORKERS];
+
+/* Jobs an RX core staged for each worker, written only by that RX core */
+typedef struct{
+	struct sa_job *job[ONVM_MAX_SA_WORKERS][SA_BURST];
+	uint16_t count[ONVM_MAX_SA_WORKERS];
+} __rte_cache_aligned SA_Stage;
+static SA_Stage sa_stage[ONVM_MAX_RX_THREADS];
+
+/* FIDs restored from a snapshot, see GMAT_snapshot_restore */
+static uint32_t *snap_fids;
+static uint32_t snap_count;
+
+/* Spins on a full worker ring before the RX core runs the jobs itself */
+#define SA_STALL_SPINS (1U << 20)
+void * thread_return[FP_MAX_CHAIN];
 
  __attribute__ ((gnu_inline)) inline void
 Pkt_View(struct rte_mbuf ** bufs, int nb_rx) {
@@ -65,37 +94,10 @@ printIP(unsigned char * d) {
 }
 
 void
-print_PA(MAT_Map LMAT[], int FID){
+print_PA(LMAT_Row LMAT[], int FID){
     printf("%d\t%d\t%d\t%d\n", LMAT[FID].PA[0], LMAT[FID].PA[1], LMAT[FID].PA[2], LMAT[FID].PA[3]);
 }
 
-void
-PktTag(struct rte_mbuf* pkt)
-{
-	unsigned char * d = PktData(pkt);
-	d = d + 14;
-	*d = *d + 128;
-}
-
-void
-Modify_FID(int Pkt_Num, struct rte_mbuf ** bufs){
-	int i;
-	for(i = 0; i < Pkt_Num ;i++)
-	{
-		unsigned char * d = PktData(bufs[i]);
-
-		uint32_t hash_fid = Hash_FID(d);
-		//printf("\nModify_FID:%d\n",hash_fid);
-		int j;
-		
-		for(j = 0;j < 4;j++)
-		{	
-			uint32_t hash_fidd = hash_fid;
-			*(d + 14 + 4 + j) = hash_fidd >> ((3-j)*8);
-			//*(d + 14 + 8) = 1;
-		}		
-	}	
-}
 
 // uint32_t
 // Hash_FID(unsigned char * d){
@@ -154,17 +156,466 @@ Hash_FID(unsigned char * d){
 
 uint32_t
 Get_FID(struct rte_mbuf ** bufs, uint16_t n){
-	unsigned char * d = PktData(bufs[n]);
-	uint32_t hash_fid = 0;
-	int i =0;
-	hash_fid = hash_fid + *(d + 14 + 4);
-	for(i=1;i<4;i++)
-	{
-		
-//		printf("step_hash_fid:%d\n",hash_fid);
-		hash_fid = (hash_fid << 8) + *(d + 14 + 4 + i);
+	return onvm_get_fp_meta(bufs[n])->fid;
+}
+
+/*
+ * Splits the NUM_OF_FLOW FIDs evenly over one GMAT shard per RX queue, the
+ * shard count is rounded up to a power of two so a FID splits with a shift.
+ */
+int
+GMAT_init(uint8_t shards){
+	uint8_t i;
+
+	GMAT_shard_bits = __builtin_ctz(NUM_OF_FLOW) - __builtin_ctz(rte_align32pow2(shards));
+	for(i = 0;i < shards;i++){
+		GMAT[i] = onvm_ft_create(1 << GMAT_shard_bits, sizeof(MAT_Map));
+		if(GMAT[i] == NULL)
+			return -1;
+		GMAT_ctr_shard[i] = rte_zmalloc("fp flow counters", sizeof(FP_Flow_Ctr) << GMAT_shard_bits, RTE_CACHE_LINE_SIZE);
+		if(GMAT_ctr_shard[i] == NULL)
+			return -1;
 	}
-	return hash_fid;
+	return 0;
+}
+
+/* The packet reading SA is the one of the first live position that has one */
+static void
+lmat_chain_pkt_sa(void){
+	uint32_t live = lmat_chain.live;
+	uint8_t pkt_sa = 0;
+
+	for(; live; live &= live - 1){
+		if(lmat_chain.sa_pkt[__builtin_ctz(live)] != NULL){
+			pkt_sa = __builtin_ctz(live) + 1;
+			break;
+		}
+	}
+	lmat_chain.pkt_sa = pkt_sa;
+}
+
+int
+lmat_chain_join(uint16_t instance_id, uint16_t service_id, SA sa, SA_SNORT sa_pkt){
+	uint16_t p;
+	uint32_t i;
+
+	if(instance_id >= MAX_NFS || lmat_chain.pos[instance_id] != 0
+			|| service_id == 0 || service_id > FP_MAX_CHAIN)
+		return -1;
+	p = service_id - 1;
+	if(LMAT[p] == NULL){
+		/* One row per FID the GMAT shards can hold */
+		LMAT[p] = rte_zmalloc("fp LMAT", sizeof(LMAT_Row) * ((size_t)num_rx_threads << GMAT_shard_bits),
+				RTE_CACHE_LINE_SIZE);
+		if(LMAT[p] == NULL)
+			return -1;
+		if(lmat_chain.len < p + 1)
+			lmat_chain.len = p + 1;
+	}
+	lmat_chain.pos[instance_id] = p + 1;
+	/* A further instance of the service, the first one's state actions stay bound */
+	if(lmat_chain.refs[p]++ != 0)
+		return 0;
+	lmat_chain.sa[p] = sa;
+	lmat_chain.sa_pkt[p] = sa_pkt;
+	/* Restored flows get no LMAT reports, they are already on the fast path */
+	for(i = 0;i < snap_count;i++){
+		if(GMAT_entry(snap_fids[i])->in_use != FP_RESTORED)
+			continue;
+		LMAT[p][snap_fids[i]].stateAction = sa;
+		LMAT[p][snap_fids[i]].stateAction_snort = sa_pkt;
+	}
+	rte_smp_wmb();
+	lmat_chain.live |= 1U << p;
+	lmat_chain_pkt_sa();
+	return 0;
+}
+
+void
+lmat_chain_leave(uint16_t instance_id){
+	struct onvm_nf_LMAT *notice;
+	uint16_t p;
+
+	if(instance_id >= MAX_NFS || lmat_chain.pos[instance_id] == 0)
+		return;
+	p = lmat_chain.pos[instance_id] - 1;
+	lmat_chain.pos[instance_id] = 0;
+	if(--lmat_chain.refs[p] != 0)
+		return;
+	lmat_chain.live &= ~(1U << p);
+	lmat_chain_pkt_sa();
+	if(rte_mempool_get(nf_LMAT_pool, (void **)&notice) != 0)
+		return;
+	notice->hash = FID_NULL;
+	notice->nf_id = 0;
+	notice->state_func_flag = IS_LEAVE;
+	if(rte_ring_enqueue(incoming_lmat_queue, notice) == -ENOBUFS)
+		rte_mempool_put(nf_LMAT_pool, notice);
+}
+
+int
+SA_module_load(const char *path, SA *sa, SA_SNORT *sa_pkt){
+	void *handle;
+
+	*sa = NULL;
+	*sa_pkt = NULL;
+	/* RTLD_NOW: an unresolved symbol must fail here, not on a fast path packet */
+	handle = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+	if(handle == NULL){
+		RTE_LOG(ERR, APP, "Cannot load state action module %s: %s\n", path, dlerror());
+		return -1;
+	}
+	*(void **)sa = dlsym(handle, ONVM_SA_SYMBOL);
+	*(void **)sa_pkt = dlsym(handle, ONVM_SA_PKT_SYMBOL);
+	if(*sa == NULL && *sa_pkt == NULL){
+		RTE_LOG(ERR, APP, "State action module %s exports neither %s nor %s\n",
+				path, ONVM_SA_SYMBOL, ONVM_SA_PKT_SYMBOL);
+		dlclose(handle);
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * Returns the FID of the packet's flow, inserting a new (flag == 0) GMAT entry
+ * for flows seen for the first time (*is_new is then set). The key is always the
+ * full 5-tuple, so two flows never share a FID. FID_NULL when the packet is not
+ * IPv4 or the shard is full, *is_new is -ENOSPC in the latter case so the RX
+ * core can replace a cold flow and retry.
+ */
+uint32_t
+GMAT_lookup_FID(uint16_t shard, struct rte_mbuf *pkt, int *is_new){
+	MAT_Map *entry;
+	int32_t tbl_index;
+
+	*is_new = 0;
+	tbl_index = onvm_ft_lookup_pkt(GMAT[shard], pkt, (char **)&entry);
+	if(likely(tbl_index >= 0))
+		return ((uint32_t)shard << GMAT_shard_bits) | (uint32_t)tbl_index;
+	if(tbl_index != -ENOENT)
+		return FID_NULL;
+
+	if(unlikely(fp_rx_stats[shard].gmat_used >= GMAT_HIGH_WATER(1U << GMAT_shard_bits))){
+		*is_new = -ENOSPC;
+		return FID_NULL;
+	}
+	tbl_index = onvm_ft_add_pkt(GMAT[shard], pkt, (char **)&entry);
+	if(unlikely(tbl_index < 0)){
+		if(tbl_index == -ENOSPC)
+			*is_new = -ENOSPC;
+		return FID_NULL;
+	}
+	/* The slot may have held an evicted flow, keep its seq running. The key
+	 * changes under it too, for readers on other cores such as the stats */
+	MAT_write_begin(entry);
+	memset((char *)entry + offsetof(MAT_Map, flag), 0, sizeof(MAT_Map) - offsetof(MAT_Map, flag));
+	onvm_ft_fill_key(&entry->key, pkt);
+	entry->sig = pkt->hash.rss;
+	if(entry->key.proto == IPPROTO_TCP)
+		entry->tw_class = FW_CLASS_TCP;
+	else if(entry->key.proto == IPPROTO_UDP)
+		entry->tw_class = FW_CLASS_UDP;
+	else
+		entry->tw_class = FW_CLASS_OTHER;
+	MAT_write_end(entry);
+	entry->in_use = 1;
+	fp_rx_stats[shard].gmat_used++;
+	memset(&GMAT_ctr_shard[shard][tbl_index], 0, sizeof(FP_Flow_Ctr));
+	*is_new = 1;
+	return ((uint32_t)shard << GMAT_shard_bits) | (uint32_t)tbl_index;
+}
+
+Flow_Wheel *
+flow_wheel_create(uint16_t shard){
+	Flow_Wheel *wheel;
+	uint32_t i;
+
+	wheel = rte_zmalloc("fp flow wheel", sizeof(Flow_Wheel), RTE_CACHE_LINE_SIZE);
+	if(wheel == NULL)
+		return NULL;
+	wheel->shard = shard;
+	wheel->base = rte_get_timer_cycles();
+	wheel->tick_cycles = rte_get_timer_hz() / 1000 * FW_TICK_MS;
+	wheel->timeout[FW_CLASS_TCP] = fp_tcp_timeout * 1000 / FW_TICK_MS;
+	wheel->timeout[FW_CLASS_UDP] = fp_udp_timeout * 1000 / FW_TICK_MS;
+	wheel->timeout[FW_CLASS_OTHER] = fp_other_timeout * 1000 / FW_TICK_MS;
+	wheel->timeout[FW_CLASS_CLOSING] = FW_CLOSE_TICKS;
+	for(i = 0;i < FW_SLOTS;i++)
+		wheel->head[i] = FID_NULL;
+	/* Restored flows age from the start of the wheel */
+	for(i = 0;i < snap_count;i++){
+		if((snap_fids[i] >> GMAT_shard_bits) == shard)
+			flow_wheel_link(wheel, snap_fids[i], flow_deadline(wheel, GMAT_entry(snap_fids[i])));
+	}
+	return wheel;
+}
+
+void
+flow_wheel_link(Flow_Wheel *wheel, uint32_t FID, uint32_t deadline){
+	MAT_Map *entry = GMAT_entry(FID);
+	uint16_t slot = deadline & (FW_SLOTS - 1);
+
+	entry->tw_slot = slot;
+	entry->tw_prev = FID_NULL;
+	entry->tw_next = wheel->head[slot];
+	if(entry->tw_next != FID_NULL)
+		GMAT_entry(entry->tw_next)->tw_prev = FID;
+	wheel->head[slot] = FID;
+	entry->tw_linked = 1;
+}
+
+void
+flow_wheel_unlink(Flow_Wheel *wheel, uint32_t FID){
+	MAT_Map *entry = GMAT_entry(FID);
+
+	if(!entry->tw_linked)
+		return;
+	if(entry->tw_prev != FID_NULL)
+		GMAT_entry(entry->tw_prev)->tw_next = entry->tw_next;
+	else
+		wheel->head[entry->tw_slot] = entry->tw_next;
+	if(entry->tw_next != FID_NULL)
+		GMAT_entry(entry->tw_next)->tw_prev = entry->tw_prev;
+	entry->tw_linked = 0;
+}
+
+uint32_t
+flow_wheel_take(Flow_Wheel *wheel, uint32_t tick){
+	uint16_t slot = tick & (FW_SLOTS - 1);
+	uint32_t FID = wheel->head[slot], next;
+
+	/* Entries of a taken list are no longer linked, callers relink or evict them */
+	wheel->head[slot] = FID_NULL;
+	for(next = FID;next != FID_NULL;next = GMAT_entry(next)->tw_next)
+		GMAT_entry(next)->tw_linked = 0;
+	return FID;
+}
+
+int
+GMAT_evict(uint32_t FID){
+	MAT_Map *entry = GMAT_entry(FID);
+	struct onvm_nf_LMAT *notice;
+
+	if(rte_mempool_get(nf_LMAT_pool, (void **)&notice) != 0)
+		return -1;
+	notice->hash = FID;
+	notice->nf_id = 0;
+	notice->state_func_flag = IS_EVICT;
+	/* Before the notice: whoever sees its cleanup also sees the new gen. A
+	 * flow kept because the ring is full only loses its in flight reports */
+	MAT_write_begin(entry);
+	entry->gen++;
+	MAT_write_end(entry);
+	if(rte_ring_enqueue(incoming_lmat_queue, notice) == -ENOBUFS){
+		rte_mempool_put(nf_LMAT_pool, notice);
+		return -1;
+	}
+	/* The FID can be reused from here on, its notice is already queued */
+	rte_hash_del_key_with_hash(GMAT[FID >> GMAT_shard_bits]->hash, &entry->key, entry->sig);
+	entry->in_use = 0;
+	fp_rx_stats[FID >> GMAT_shard_bits].gmat_used--;
+	GMAT_ctr(FID)->pkts = 0;
+	MAT_write_begin(entry);
+	entry->flag = 0;
+	entry->cpa.action = ACTION_NULL;
+	entry->cpa.mask = 0;
+	MAT_write_end(entry);
+	return 0;
+}
+
+int
+GMAT_snapshot_save(const char *path){
+	char tmp[PATH_MAX];
+	FP_Snap_Hdr hdr;
+	FP_Snap_Rec rec;
+	MAT_Map *entry;
+	const void *key;
+	void *data;
+	FILE *f;
+	uint32_t s, next;
+	uint64_t n = 0;
+	int32_t idx;
+	uint16_t shard;
+	int flag;
+
+	snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+	f = fopen(tmp, "w");
+	if(f == NULL)
+		return -1;
+	/* The header goes last, once the count is known */
+	memset(&hdr, 0, sizeof(hdr));
+	if(fwrite(&hdr, sizeof(hdr), 1, f) != 1){
+		fclose(f);
+		return -1;
+	}
+	/* Only the flows in each shard's hash, not every FID */
+	for(shard = 0;shard < num_rx_threads;shard++){
+		for(next = 0;(idx = onvm_ft_iterate(GMAT[shard], &key, &data, &next)) >= 0;){
+			entry = (MAT_Map *)data;
+			/* The RX core may evict and reuse the entry meanwhile, only keep a stable copy */
+			do{
+				s = fp_seq_read_begin(&entry->seq);
+				flag = entry->flag;
+				rec.key = entry->key;
+				rec.sig = entry->sig;
+				rec.tw_class = entry->tw_class;
+				rec.cpa = entry->cpa;
+			}while(fp_seq_read_retry(&entry->seq, s));
+			if(flag != 1 || !entry->in_use)
+				continue;
+			/* Tunnel ids are only valid until the NFs register their templates again */
+			if(rec.cpa.action == ACTION_SLOW || rec.cpa.decap || rec.cpa.encap)
+				continue;
+			rec.shard = shard;
+			rec.pad = 0;
+			rec.cpa.urt = 0;
+			if(fwrite(&rec, sizeof(rec), 1, f) != 1){
+				fclose(f);
+				return -1;
+			}
+			n++;
+		}
+	}
+	memcpy(hdr.magic, FP_SNAP_MAGIC, sizeof(hdr.magic));
+	hdr.version = FP_SNAP_VERSION;
+	hdr.rec_size = sizeof(FP_Snap_Rec);
+	hdr.shards = num_rx_threads;
+	hdr.shard_bits = GMAT_shard_bits;
+	hdr.count = n;
+	hdr.taken = time(NULL);
+	if(fseek(f, 0, SEEK_SET) != 0 || fwrite(&hdr, sizeof(hdr), 1, f) != 1
+			|| fflush(f) != 0 || fsync(fileno(f)) != 0){
+		fclose(f);
+		return -1;
+	}
+	if(fclose(f) != 0 || rename(tmp, path) != 0)
+		return -1;
+	return n;
+}
+
+int
+GMAT_snapshot_restore(const char *path){
+	const FP_Snap_Hdr *hdr;
+	const FP_Snap_Rec *rec;
+	MAT_Map *entry;
+	struct stat st;
+	uint64_t i;
+	int32_t tbl_index;
+	int fd;
+
+	fd = open(path, O_RDONLY);
+	if(fd < 0)
+		return -1;
+	if(fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(FP_Snap_Hdr)){
+		close(fd);
+		return -1;
+	}
+	hdr = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if(hdr == MAP_FAILED)
+		return -1;
+	if(memcmp(hdr->magic, FP_SNAP_MAGIC, sizeof(hdr->magic)) != 0 || hdr->version != FP_SNAP_VERSION
+			|| hdr->rec_size != sizeof(FP_Snap_Rec) || hdr->shards != num_rx_threads
+			|| hdr->shard_bits != GMAT_shard_bits
+			|| (size_t)st.st_size < sizeof(FP_Snap_Hdr) + hdr->count * sizeof(FP_Snap_Rec)){
+		munmap((void *)hdr, st.st_size);
+		return -1;
+	}
+	snap_fids = rte_malloc("fp snapshot FIDs", sizeof(uint32_t) * (hdr->count + 1), 0);
+	if(snap_fids == NULL){
+		munmap((void *)hdr, st.st_size);
+		return -1;
+	}
+	rec = (const FP_Snap_Rec *)(hdr + 1);
+	for(i = 0;i < hdr->count;i++){
+		if(rec[i].shard >= num_rx_threads
+				|| fp_rx_stats[rec[i].shard].gmat_used >= GMAT_HIGH_WATER(1U << GMAT_shard_bits))
+			continue;
+		tbl_index = rte_hash_add_key_with_hash(GMAT[rec[i].shard]->hash, &rec[i].key, rec[i].sig);
+		if(tbl_index < 0)
+			continue;
+		entry = (MAT_Map *)onvm_ft_get_data(GMAT[rec[i].shard], tbl_index);
+		memset(entry, 0, sizeof(*entry));
+		entry->key = rec[i].key;
+		entry->sig = rec[i].sig;
+		entry->tw_class = rec[i].tw_class;
+		entry->cpa = rec[i].cpa;
+		entry->flag = 1;
+		entry->in_use = FP_RESTORED;
+		fp_rx_stats[rec[i].shard].gmat_used++;
+		snap_fids[snap_count++] = ((uint32_t)rec[i].shard << GMAT_shard_bits) | (uint32_t)tbl_index;
+	}
+	munmap((void *)hdr, st.st_size);
+	return snap_count;
+}
+
+void
+GMAT_flow_cleanup(uint32_t FID){
+	int i;
+
+	for(i = 0;i < lmat_chain.len;i++){
+		if(LMAT[i] == NULL)
+			continue;
+		MAT_write_begin(&LMAT[i][FID]);
+		memset((char *)&LMAT[i][FID] + offsetof(LMAT_Row, PA), 0, sizeof(LMAT_Row) - offsetof(LMAT_Row, PA));
+		MAT_write_end(&LMAT[i][FID]);
+	}
+	OP_LMAT_bef_cons[FID] = 0;
+	FP_LMAT_bef_cons[FID] = 0;
+	/* Most flows never had a rule, leave their URT page untouched */
+	if(URT[FID].num_rules != 0){
+		fp_seq_write_begin(&URT[FID].seq);
+		memset(URT[FID].rule, 0, sizeof(URT[FID].rule));
+		URT[FID].num_rules = 0;
+		URT[FID].armed = 0;
+		fp_seq_write_end(&URT[FID].seq);
+	}
+}
+
+Park_Pool *
+park_pool_create(void){
+	Park_Pool *pool;
+	uint16_t i;
+
+	pool = rte_zmalloc("fp park pool", sizeof(Park_Pool), RTE_CACHE_LINE_SIZE);
+	if(pool == NULL)
+		return NULL;
+	for(i = 0;i < PARK_SLOTS;i++)
+		pool->free_list[i] = PARK_SLOTS - i;
+	pool->free_count = PARK_SLOTS;
+	pool->timeout_cycles = rte_get_timer_hz() / 1000000 * PARK_TIMEOUT_US;
+	return pool;
+}
+
+/*
+ * Takes a parking slot for FID. Returns 1 + slot index, or 0 when every slot
+ * is in use, in which case the flow simply keeps using the slow path.
+ */
+uint16_t
+park_slot_get(Park_Pool *pool, uint32_t FID){
+	uint16_t park;
+	Park_Slot *slot;
+
+	if(unlikely(pool->free_count == 0))
+		return 0;
+	park = pool->free_list[--pool->free_count];
+	slot = park_slot(pool, park);
+	slot->FID = FID;
+	slot->count = 0;
+	slot->deadline = rte_get_timer_cycles() + pool->timeout_cycles;
+	pool->active_pos[park - 1] = pool->active_count;
+	pool->active[pool->active_count++] = park;
+	return park;
+}
+
+void
+park_slot_put(Park_Pool *pool, uint16_t park){
+	uint16_t pos = pool->active_pos[park - 1];
+	uint16_t last = pool->active[--pool->active_count];
+
+	pool->active[pos] = last;
+	pool->active_pos[last - 1] = pos;
+	pool->free_list[pool->free_count++] = park;
 }
 
 uint32_t
@@ -189,6 +640,10 @@ Modify(uint16_t Field, int Value, struct rte_mbuf * b[],int Pkt_ID)
 {
 	uint16_t i;
 	unsigned char * d = PktData(b[Pkt_ID]);
+	int is_ip = Field < 20 && Field > 10;
+	uint32_t old = fp_csum_sum(d + 14 + Field, is_ip ? 4 : 2);
+	uint16_t delta;
+
 	if(Field < 20 && Field >10)
 	{
 		for(i=0;i<4;i++)
@@ -206,6 +661,9 @@ Modify(uint16_t Field, int Value, struct rte_mbuf * b[],int Pkt_ID)
 		}
 
 	}
+	/* RFC 1624: the addresses are in the IPv4 and the pseudo header, the ports only in L4 */
+	delta = fp_csum_delta(old, fp_csum_sum(d + 14 + Field, is_ip ? 4 : 2));
+	fp_csum_update(b[Pkt_ID], d + 14, (d[14] & 0x0f) * 4, is_ip ? delta : 0, delta, 0);
 //	printf("\nSIP:\n");
 //	printIP(d+14+12);
 //	printf("DIP:\n");
@@ -214,9 +672,10 @@ Modify(uint16_t Field, int Value, struct rte_mbuf * b[],int Pkt_ID)
 }
 
 void
-LMAT_add_rule(MAT_Map LMAT[], int FID, int packet_action, int field, int value, SA stateaction){
+LMAT_add_rule(LMAT_Row LMAT[], int FID, int packet_action, int field, int value, int port, SA stateaction){
     //int PA_val, field_val;
 //    printf("LMAT:1\n");
+	MAT_write_begin(&LMAT[FID]);
     LMAT[FID].PA[0] = packet_action;
     LMAT[FID].PA[1] = field;
     LMAT[FID].PA[2] = value;
@@ -224,23 +683,22 @@ LMAT_add_rule(MAT_Map LMAT[], int FID, int packet_action, int field, int value,
 
 		
 
-    if(packet_action == ACTION_DROP){
-    	LMAT[FID].PA[3] = FIELD_NULL;
-    }
+    LMAT[FID].PA[3] = port;
+	MAT_write_end(&LMAT[FID]);
 //    printf("LMAT:2\n");
 }
 
 void
-LMAT_add_rule_snort(MAT_Map LMAT[], int FID, int packet_action, int field, int value, SA_SNORT stateaction){
+LMAT_add_rule_snort(LMAT_Row LMAT[], int FID, int packet_action, int field, int value, int port, SA_SNORT stateaction){
     //int PA_val, field_val;
 //    printf("LMAT:1\n");
+	MAT_write_begin(&LMAT[FID]);
     LMAT[FID].PA[0] = packet_action;
     LMAT[FID].PA[1] = field;
     LMAT[FID].PA[2] = value;
 	LMAT[FID].stateAction_snort = stateaction;
-    if(packet_action == ACTION_DROP){
-    	LMAT[FID].PA[3] = FIELD_NULL;
-    }
+    LMAT[FID].PA[3] = port;
+	MAT_write_end(&LMAT[FID]);
 //    printf("LMAT:2\n");
 }
 
@@ -251,80 +709,423 @@ LMAT_add_rule_snort(MAT_Map LMAT[], int FID, int packet_action, int field, int v
 
 
 
+int
+URT_add_rule(int FID, uint16_t pos, const volatile void *state, uint8_t type, uint8_t op,
+             uint64_t operand, const int action[3]){
+    URT_Map *urt = &URT[FID];
+    MAT_Map *entry;
+    int r;
+
+    if (state == NULL || pos >= FP_MAX_CHAIN)
+        return -1;
+    fp_seq_write_begin(&urt->seq);
+    r = urt->num_rules;
+    if (r < URT_MAX_RULES) {
+        urt->rule[r].state = state;
+        urt->rule[r].operand = operand;
+        urt->rule[r].type = type;
+        urt->rule[r].op = op;
+        urt->rule[r].pos = pos;
+        urt->rule[r].action[0] = action[0];
+        urt->rule[r].action[1] = action[1];
+        urt->rule[r].action[2] = action[2];
+        urt->num_rules++;
+        urt->armed |= 1U << r;
+    } else {
+        r = -1;
+    }
+    fp_seq_write_end(&urt->seq);
+    if (r < 0)
+        return -1;
+
+    /* Already installed flows pick the rule up on their next hit */
+    entry = GMAT_entry(FID);
+    MAT_write_begin(entry);
+    entry->cpa.urt = 1;
+    MAT_write_end(entry);
+    return r;
+}
+
 void
 register_URT(int FID, int* state_address, int condition_threshold, int update_action[3]){
-    URT[FID].state_address = state_address;
-    URT[FID].condition_threshold = condition_threshold;
-    URT[FID].update_action = update_action;
+    URT_add_rule(FID, 0, state_address, URT_STATE_I32, URT_CMP_GT, (uint64_t)(int64_t)condition_threshold, update_action);
 //    printf("Regi_URT:1\n");
 }
 
-int*
-PA_consolidation(int FID){ //2017-8-26 19:08:39 JYM：目前的算法就只考虑了Modify和Drop两种Paction Action
+static int
+URT_compare(uint8_t op, uint64_t v, uint64_t operand, int is_signed){
+    int64_t sv = (int64_t)v, so = (int64_t)operand;
+
+    switch (op) {
+    case URT_CMP_GT: return is_signed ? sv > so : v > operand;
+    case URT_CMP_GE: return is_signed ? sv >= so : v >= operand;
+    case URT_CMP_LT: return is_signed ? sv < so : v < operand;
+    case URT_CMP_LE: return is_signed ? sv <= so : v <= operand;
+    case URT_CMP_EQ: return v == operand;
+    case URT_CMP_NE: return v != operand;
+    case URT_CMP_ANY: return (v & operand) != 0;
+    default: return 0;
+    }
+}
+
+static int
+URT_rule_match(const URT_Rule *rule, uint64_t now){
+    switch (rule->type) {
+    case URT_STATE_I32:
+        return URT_compare(rule->op, (uint64_t)(int64_t)*(const volatile int32_t *)rule->state, rule->operand, 1);
+    case URT_STATE_U32:
+        return URT_compare(rule->op, *(const volatile uint32_t *)rule->state, rule->operand, 0);
+    case URT_STATE_U64:
+        return URT_compare(rule->op, *(const volatile uint64_t *)rule->state, rule->operand, 0);
+    case URT_STATE_TSC:
+        return URT_compare(rule->op, now - *(const volatile uint64_t *)rule->state, rule->operand, 0);
+    default:
+        return 0;
+    }
+}
+
+/* Same byte layout Modify() writes: addresses and ports in network order */
+static void
+PA_compile_rewrite(FP_CPA *cpa, int field, int value){
+	static const uint8_t off[NUM_OF_FIELD] = {
+		[FIELD_SRCIP] = S_IP - FP_RW_OFF, [FIELD_SRCPORT] = S_Port - FP_RW_OFF,
+		[FIELD_DSTIP] = D_IP - FP_RW_OFF, [FIELD_DSTPORT] = D_Port - FP_RW_OFF,
+	};
+	static const uint8_t len[NUM_OF_FIELD] = {
+		[FIELD_SRCIP] = 4, [FIELD_SRCPORT] = 2, [FIELD_DSTIP] = 4, [FIELD_DSTPORT] = 2,
+	};
+	int b;
+
+	cpa->mask |= 1U << field;
+	for(b = 0;b < len[field];b++){
+		cpa->rw_mask[off[field] + b] = 0xff;
+		cpa->rw_val[off[field] + b] = (uint32_t)value >> ((len[field] - 1 - b) * 8);
+	}
+}
+
+static int
+PA_tunnel_valid(int id){
+	return fp_tunnels != NULL && id >= 0 && id < ONVM_MAX_TUNNELS && fp_tunnels->t[id].valid;
+}
+
+static int
+PA_fold(FP_CPA *cpa, int action){
+	memset(cpa, 0, sizeof(*cpa));
+	cpa->action = action;
+	return action;
+}
+
+/* RFC 1624 deltas of the rewrite, computed once from the header the flow's GMAT key holds */
+static void
+PA_compile_csum(FP_CPA *cpa, const struct onvm_ft_ipv4_5tuple *key){
+	uint8_t old[12], upd[12];
+	int b;
+
+	memcpy(old, &key->src_addr, 4);
+	memcpy(old + 4, &key->dst_addr, 4);
+	memcpy(old + 8, &key->src_port, 2);
+	memcpy(old + 10, &key->dst_port, 2);
+	for(b = 0;b < 12;b++)
+		upd[b] = (old[b] & ~cpa->rw_mask[b]) | cpa->rw_val[b];
+	cpa->ip_csum = fp_csum_delta(fp_csum_sum(old, 8), fp_csum_sum(upd, 8));
+	cpa->l4_csum = fp_csum_delta(fp_csum_sum(old, 12), fp_csum_sum(upd, 12));
+	cpa->csum |= FP_CSUM_PRE;
+}
+
+int
+PA_consolidation(int FID, FP_CPA *cpa){ //2017-8-26 19:08:39 JYM：目前的算法就只考虑了Modify和Drop两种Paction Action
     int i;
-    // int cpa[4] = {0,0,0,0};
-	int* cpa = (int *)malloc(4);
-	int* record_modify = (int *) malloc(4);
-	for(i=0;i<4;i++){
-		record_modify[i] = 0;
-		cpa[i] = 0;
-	}
-	// printf("--1\n");
-    // int record_modify[NUM_OF_FIELD] = {0};//排除了Drop的情况后，剩下要记录modify情况下的field-value键值对，相当于记录每个位置的
-    for(i = 0; i < NUM_OF_NF; i ++){
-		// printf("LMAT[i][FID].PA[0]:%d\n",LMAT[i][FID].PA[0]);
-        if (LMAT[i][FID].PA[0]==ACTION_DROP){
-//            cpa = calloc(4, sizeof(int));
-            cpa[0] = ACTION_DROP;
-            cpa[1] = FIELD_NULL;
-            cpa[2] = VALUE_NULL;
-            cpa[3] = VALUE_NULL;
-            flag_PA = ACTION_DROP;
-            return cpa;
+    int pa[4];
+    int outer = 0;//an NF before this one encapsulated, modifies hit the outer header
+    int port;
+    uint32_t live = lmat_chain.live;
+
+	PA_fold(cpa, ACTION_NULL);
+	port = FP_OUT_PORT_DEFAULT;
+    //排除了Drop的情况后，剩下要记录modify情况下的field-value键值对，相当于记录每个位置的
+    for(i = 0; i < FP_MAX_CHAIN; i ++){
+		if(!(live & (1U << i)))
+			continue;
+		MAT_read_PA(&LMAT[i][FID], pa);
+		if (pa[3] >= 0 && pa[3] < RTE_MAX_ETHPORTS)
+			port = pa[3];
+        if (pa[0]==ACTION_DROP){
+            return PA_fold(cpa, ACTION_DROP);
         }
-		else if (LMAT[i][FID].PA[0]==ACTION_NULL){
+		else if (pa[0]==ACTION_DECAP){
+			if(!PA_tunnel_valid(pa[2]))
+				return PA_fold(cpa, ACTION_SLOW);
+			if(cpa->encap){
+				/* Terminates the tunnel an earlier NF originated, with what it rewrote in it */
+				if(cpa->encap != pa[2] + 1)
+					return PA_fold(cpa, ACTION_SLOW);
+				cpa->encap = 0;
+				outer = 0;
+				if(cpa->rw_outer){
+					memset(cpa->rw_mask, 0, sizeof(cpa->rw_mask));
+					memset(cpa->rw_val, 0, sizeof(cpa->rw_val));
+					cpa->mask = 0;
+					cpa->rw_outer = 0;
+				}
+				continue;
+			}
+			if(cpa->decap)//nested tunnels take the NFs
+				return PA_fold(cpa, ACTION_SLOW);
+			/* Earlier modifies were to the outer header the decapsulation removes */
+			PA_fold(cpa, ACTION_NULL);
+			cpa->decap = pa[2] + 1;
+			continue;
+		}
+		else if (pa[0]==ACTION_ENCAP){
+			if(!PA_tunnel_valid(pa[2]) || cpa->encap)
+				return PA_fold(cpa, ACTION_SLOW);
+			cpa->encap = pa[2] + 1;
+			outer = 1;
 			continue;
 		}
-		// printf("--45\n");
-        record_modify[LMAT[i][FID].PA[1]] = LMAT[i][FID].PA[2];//由于是modify操作，每次会覆盖前面的结果
+		else if (pa[0]!=ACTION_MODIFY || pa[1] < 0 || pa[1] >= NUM_OF_FIELD){
+			continue;
+		}
+		/* No UDP header in a GRE outer, ports at ip + ihl would land in the GRE header */
+		if(outer && (pa[1] == FIELD_SRCPORT || pa[1] == FIELD_DSTPORT)
+				&& !fp_tunnels->t[cpa->encap - 1].udp)
+			return PA_fold(cpa, ACTION_SLOW);
+		/* One rewrite per packet: the inner header before encapsulation or the outer one after */
+		if(outer && !cpa->rw_outer){
+			if(cpa->mask)
+				return PA_fold(cpa, ACTION_SLOW);
+			cpa->rw_outer = 1;
+		}
+        PA_compile_rewrite(cpa, pa[1], pa[2]);//由于是modify操作，每次会覆盖前面的结果
     }
-	// printf("--2\n");
-   // printf("\n----------------------------------------------\nConsolidation Results:\n" );
-   // printf("SRCIP\tSRCPORT\tDSTIP\tDSTPORT\n");
-   // printf("0x%x\t0x%x\t0x%x\t0x%x\n", record_modify[FIELD_SRCIP], record_modify[FIELD_SRCPORT], record_modify[FIELD_DSTIP], record_modify[FIELD_DSTPORT]);
-   // printf("----------------------------------------------\n" );
-    flag_PA = ACTION_MODIFY;
-    return record_modify;
+	if(cpa->mask || cpa->decap || cpa->encap)
+		cpa->action = ACTION_MODIFY;
+	cpa->port = port;
+	/* Decapsulated and pushed headers are not the key's, fp_rewrite works their deltas out per packet */
+	if(cpa->mask && !cpa->decap && !cpa->rw_outer)
+		PA_compile_csum(cpa, &GMAT_entry(FID)->key);
+    return cpa->action;
 }
 
-void
-check_URT(MAT_Map LMAT[], int FID){ //register update rule
-    int condition_threshold = URT[FID].condition_threshold;
-    int* state_address = URT[FID].state_address;
-    int* update_action = URT[FID].update_action;
-    if (URT[FID].is_updated==0 && *state_address > condition_threshold) { // match
-        LMAT[FID].PA[0] = update_action[0];
-        LMAT[FID].PA[1] = update_action[1];
-        LMAT[FID].PA[2] = update_action[2];
-        URT[FID].is_updated = 1;
-//        printf("action of FID=%d has been updated to %d\n", FID, update_action[0]);
+int
+check_URT(int FID, uint32_t gen){ //register update rule
+    URT_Map *urt = &URT[FID];
+    URT_Rule rule[URT_MAX_RULES];
+    uint8_t armed, matched = 0, fired = 0;
+    uint64_t now = 0;
+    uint32_t s;
+    int r, num_rules;
+
+    /* The flow was evicted since, the rules are another flow's or none */
+    if (GMAT_entry(FID)->gen != gen)
+        return 0;
+    do{
+        s = fp_seq_read_begin(&urt->seq);
+        armed = urt->armed;
+        num_rules = urt->num_rules;
+        for (r = 0; r < num_rules; r++)
+            rule[r] = urt->rule[r];
+    }while(fp_seq_read_retry(&urt->seq, s));
 
+    for (r = 0; r < num_rules; r++) {
+        if (!(armed & (1U << r)))
+            continue;
+        if (rule[r].type == URT_STATE_TSC && now == 0)
+            now = rte_get_tsc_cycles();
+        if (URT_rule_match(&rule[r], now)) // match
+            matched |= 1U << r;
     }
-    int *cpa;
-    cpa = PA_consolidation(FID);
-    add_rule_to_GMAT(FID, cpa);
+    if (matched == 0)
+        return 0;
+
+    /* Another core may have fired the rules since the snapshot */
+    fp_seq_write_begin(&urt->seq);
+    matched &= urt->armed;
+    if (GMAT_entry(FID)->gen != gen)
+        matched = 0;
+    for (r = 0; r < num_rules; r++) {
+        if (!(matched & (1U << r)))
+            continue;
+        if (rule[r].pos < lmat_chain.len && LMAT[rule[r].pos] != NULL) {
+            MAT_write_begin(&LMAT[rule[r].pos][FID]);
+            LMAT[rule[r].pos][FID].PA[0] = rule[r].action[0];
+            LMAT[rule[r].pos][FID].PA[1] = rule[r].action[1];
+            LMAT[rule[r].pos][FID].PA[2] = rule[r].action[2];
+            MAT_write_end(&LMAT[rule[r].pos][FID]);
+        }
+        fired++;
+    }
+    urt->armed &= ~matched;
+    fp_seq_write_end(&urt->seq);
+//        printf("action of FID=%d has been updated to %d\n", FID, update_action[0]);
+
+    if (fired > 0)
+        add_rule_to_GMAT(FID, gen);
+    return fired;
 }
 
 void
-SA_parallel_execution(int FID, int snort_seq, struct rte_mbuf* pkt){ //单线程只执行最长时间的SF
+SA_parallel_execution(int FID, int snort_seq, struct rte_mbuf* pkt){ //单线程依次执行链上每个NF的SA
+	uint32_t live = lmat_chain.live;
+	int pos;
 
-	//int i;
-	if(snort_seq < 0)//no snort
-	{
-		execute_SA(LMAT[SF_ID], FID);
-	}else{//snort_seq >= 0, snort exists
-		execute_SA_snort(LMAT[snort_seq], FID, pkt);
-	}	
+	/* Same jobs as SA_dispatch, run in chain order on this core */
+	for(; live; live &= live - 1){
+		pos = __builtin_ctz(live);
+		if(pos == snort_seq)
+			execute_SA_snort(LMAT[pos], FID, pkt);
+		else
+			execute_SA(LMAT[pos], FID);
+	}
+}
+
+int
+SA_workers_init(uint8_t rx_threads, uint8_t workers){
+	char name[RTE_RING_NAMESIZE];
+	unsigned r, w;
+
+	if(workers == 0)
+		return 0;
+	/* Enough for full rings, full stages, the batches being run and the lcore caches */
+	sa_job_pool = rte_mempool_create(SA_JOB_POOL_NAME,
+			rx_threads * workers * (SA_RING_SIZE + SA_BURST) + workers * SA_BURST + RTE_MAX_LCORE * SA_BURST * 3 / 2,
+			sizeof(struct sa_job), SA_BURST, 0, NULL, NULL, NULL, NULL, rte_socket_id(), NO_FLAGS);
+	if(sa_job_pool == NULL)
+		return -1;
+	for(r = 0;r < rx_threads;r++){
+		for(w = 0;w < workers;w++){
+			snprintf(name, sizeof(name), SA_RING_NAME, r, w);
+			sa_ring[r][w] = rte_ring_create(name, SA_RING_SIZE, rte_socket_id(), RING_F_SP_ENQ | RING_F_SC_DEQ);
+			if(sa_ring[r][w] == NULL)
+				return -1;
+		}
+	}
+	return 0;
+}
+
+static inline void
+SA_run_job(struct sa_job *job){
+	/* Queued before the flow was evicted, the FID may hold another flow now */
+	if(unlikely(GMAT_entry(job->FID)->gen != job->gen)){
+		if(job->pkt != NULL)
+			rte_pktmbuf_free(job->pkt);
+		return;
+	}
+	if(job->pkt != NULL){
+		execute_SA_snort(LMAT[job->pos], job->FID, job->pkt);
+		rte_pktmbuf_free(job->pkt);//drops the reference SA_dispatch took
+	}else{
+		execute_SA(LMAT[job->pos], job->FID);
+	}
+	if(job->urt)
+		check_URT(job->FID, job->gen);
+}
+
+static void
+SA_stage_flush(uint16_t rx_id, unsigned w){
+	SA_Stage *stage = &sa_stage[rx_id];
+	struct sa_job **job = stage->job[w];
+	unsigned n = stage->count[w], done = 0, spins = 0, i;
+
+	stage->count[w] = 0;
+	/* Back pressure: the worker stays the only one running its positions' SAs */
+	while(done < n){
+		done += rte_ring_sp_enqueue_burst(sa_ring[rx_id][w], (void **)job + done, n - done);
+		if(done == n)
+			break;
+		if(unlikely(++spins == SA_STALL_SPINS))
+			break;
+		rte_pause();
+	}
+	fp_rx_stats[rx_id].sa_jobs += done;
+	fp_rx_stats[rx_id].sa_stall += spins;
+	if(likely(done == n))
+		return;
+	/* The worker is gone or wedged, e.g. on shutdown */
+	for(i = done;i < n;i++)
+		SA_run_job(job[i]);
+	rte_mempool_put_bulk(sa_job_pool, (void **)job + done, n - done);
+	fp_rx_stats[rx_id].sa_inline += n - done;
+}
+
+void
+SA_dispatch(uint16_t rx_id, int FID, uint32_t gen, int snort_seq, struct rte_mbuf* pkt, uint8_t urt){
+	SA_Stage *stage = &sa_stage[rx_id];
+	struct sa_job *jobs[FP_MAX_CHAIN];
+	struct sa_job job;
+	uint32_t live = lmat_chain.live;
+	unsigned n = __builtin_popcount(live), i = 0, w;
+	uint16_t pos;
+
+	if(n == 0)
+		return;
+	if(unlikely(rte_mempool_get_bulk(sa_job_pool, (void **)jobs, n) != 0)){
+		/* Cannot happen with the pool sized as above, stay correct anyway */
+		job.FID = FID;
+		job.gen = gen;
+		job.urt = 0;
+		for(; live; live &= live - 1){
+			job.pos = __builtin_ctz(live);
+			job.pkt = NULL;
+			if(job.pos == snort_seq){
+				rte_mbuf_refcnt_update(pkt, 1);
+				job.pkt = pkt;
+			}
+			SA_run_job(&job);
+		}
+		if(urt)
+			check_URT(FID, gen);
+		fp_rx_stats[rx_id].sa_inline += n;
+		return;
+	}
+	for(; live; live &= live - 1){
+		pos = __builtin_ctz(live);
+		jobs[i]->FID = FID;
+		jobs[i]->gen = gen;
+		jobs[i]->pos = pos;
+		jobs[i]->urt = urt;
+		jobs[i]->pkt = NULL;
+		if(pos == snort_seq){
+			/* The packet is forwarded before the worker reads it */
+			rte_mbuf_refcnt_update(pkt, 1);
+			jobs[i]->pkt = pkt;
+		}
+		w = pos % num_sa_workers;
+		stage->job[w][stage->count[w]++] = jobs[i++];
+		if(stage->count[w] == SA_BURST)
+			SA_stage_flush(rx_id, w);
+	}
+}
+
+void
+SA_dispatch_flush(uint16_t rx_id){
+	SA_Stage *stage = &sa_stage[rx_id];
+	unsigned w;
+
+	for(w = 0;w < num_sa_workers;w++){
+		if(stage->count[w] != 0)
+			SA_stage_flush(rx_id, w);
+	}
+}
+
+unsigned
+SA_worker_poll(uint8_t worker){
+	struct sa_job *jobs[SA_BURST];
+	unsigned r, i, n, total = 0;
+
+	for(r = 0;r < num_rx_threads;r++){
+		n = rte_ring_sc_dequeue_burst(sa_ring[r][worker], (void **)jobs, SA_BURST);
+		if(n == 0)
+			continue;
+		for(i = 0;i < n;i++){
+			if(i + 1 < n)
+				rte_prefetch0(&LMAT[jobs[i + 1]->pos][jobs[i + 1]->FID]);
+			SA_run_job(jobs[i]);
+		}
+		rte_mempool_put_bulk(sa_job_pool, (void **)jobs, n);
+		total += n;
+	}
+	return total;
 }
 
 // void
@@ -435,25 +1236,26 @@ SA_parallel_execution(int FID, int snort_seq, struct rte_mbuf* pkt){ //单线程
 // }
 
 void
-execute_SA(MAT_Map LMAT[], int FID){
+execute_SA(LMAT_Row LMAT[], int FID){
 //	printf("execute_SA:1\n");
     SA s_action;
 //    printf("execute_SA:2\n");
     s_action = LMAT[FID].stateAction;
 //    printf("execute_SA:3\n");
-    s_action(FID);
+    if(s_action != NULL)
+        s_action(FID);
 //    printf("execute_SA:4\n");
 }
 
 void
-execute_SA_snort(MAT_Map LMAT[], int FID, struct rte_mbuf* pkt){
+execute_SA_snort(LMAT_Row LMAT[], int FID, struct rte_mbuf* pkt){
 //	printf("execute_SA:1\n");
     SA_SNORT s_action;
 //    printf("execute_SA:2\n");
-	FID =  hash_fid;
     s_action = LMAT[FID].stateAction_snort;
 //    printf("execute_SA:3\n");
-    s_action(pkt);
+    if(s_action != NULL)
+        s_action(pkt);
 //    printf("execute_SA:4\n");
 }
 
@@ -465,22 +1267,34 @@ uint32_t delay(uint32_t x , uint32_t control){
 }
 
 void
-add_rule_to_GMAT(int FID, int *cpa){
-	GMAT[FID].flag = 1;
-	GMAT[FID].PA[0] = cpa[0];
-	GMAT[FID].PA[1] = cpa[1];
-	GMAT[FID].PA[2] = cpa[2];
-	GMAT[FID].PA[3] = cpa[3];
+add_rule_to_GMAT(int FID, uint32_t gen){
+	MAT_Map *entry = GMAT_entry(FID);
+
+	/* RX cores reading the entry meanwhile retry instead of seeing half an action */
+	MAT_write_begin(entry);
+	if(entry->gen == gen){
+		PA_consolidation(FID, &entry->cpa);
+		entry->cpa.urt = URT[FID].armed != 0;
+		entry->flag = 1;
+	}
+	MAT_write_end(entry);
 }
 
 void
-execute_GMAT_rule(int FID, int CPA[], int snort_seq, struct rte_mbuf* pkt){
+GMAT_consolidate(int FID, uint32_t gen){
+	/*--------------LMAT: filled by onvm_nf_check_LMAT as each NF reported-------------*/
+
+	/*--------------GMAT: State Action Parallel Execution-------------*/
+	SA_parallel_execution(FID, -1, NULL);
+
+	/*--------------GMAT: Packet Action Consolidation -------------*/
+	add_rule_to_GMAT(FID, gen);
+}
+
+void
+execute_GMAT_rule(int FID, FP_CPA *cpa, int snort_seq, struct rte_mbuf* pkt){
 	SA_parallel_execution(FID, snort_seq, pkt);
-	int hyc_i = 0;
-	for (hyc_i = 0;hyc_i < 4;hyc_i++)
-	{
-		CPA[hyc_i] = GMAT[FID].PA[hyc_i];
-	}
+	MAT_read_CPA(GMAT_entry(FID), cpa);
 //	CPA = GMAT[FID].PA;
 //	printf("\nexecute_GMAT_rule2\n");
 }
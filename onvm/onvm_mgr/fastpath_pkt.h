@@ -1,6 +1,14 @@
 #ifndef _FASTPATH_PKT_H_
 #define _FASTPATH_PKT_H_
 
+#include <string.h>
+
+#include <rte_ether.h>
+#include <rte_ip.h>
+#include <rte_vect.h>
+
+#include "onvm_flow_table.h"
+#include "fp_csum.h"
 
 #define NUM_OF_ACTION 4
 #define ACTION_NULL -1
@@ -8,6 +16,7 @@
 #define ACTION_DROP 1
 #define ACTION_ENCAP 2
 #define ACTION_DECAP 3
+#define ACTION_SLOW -2 //GMAT only: the chain's actions do not fold into one CPA, its packets keep taking the NFs
 
 #define NUM_OF_FIELD 4
 #define FIELD_NULL -1
@@ -16,37 +25,137 @@
 #define FIELD_DSTIP 2
 #define FIELD_DSTPORT 3
 #define VALUE_NULL -1
-#define NUM_OF_FLOW 10000
 #define S_IP 12
 #define D_IP 16
 #define _FID 4
 #define S_Port 20
 #define D_Port 22
+#define FP_RW_OFF 12 //first IPv4 header byte a compiled rewrite covers, S_IP
+#define FP_RW_LEN 16 //S_IP through D_Port, one SSE register
 #define IS_OP 0
 #define IS_FP 1
+#define IS_EVICT 2 //state_func_flag of the notice an RX core posts on incoming_lmat_queue when it evicts a flow
+#define IS_LEAVE 3 //notice of lmat_chain_leave, pending flows are checked against the smaller chain
 #define SF_ID 0
 
+#define URT_MAX_RULES 4 //update rules a flow can hold
+/* Type of the NF state an update rule reads */
+#define URT_STATE_I32 0 //int, e.g. a legacy counter
+#define URT_STATE_U32 1 //counter or flag word
+#define URT_STATE_U64 2 //packet/byte total
+#define URT_STATE_TSC 3 //uint64_t TSC timestamp, compared as its age in cycles
+/* How the state is compared with the rule's operand */
+#define URT_CMP_GT 0
+#define URT_CMP_GE 1
+#define URT_CMP_LT 2
+#define URT_CMP_LE 3
+#define URT_CMP_EQ 4
+#define URT_CMP_NE 5
+#define URT_CMP_ANY 6 //state & operand != 0
+
 
 #define PKT_NUM 91625
 #define FID_NUM 5750
-#define NUM_OF_NF 1
+#define FP_MAX_CHAIN 16 //NFs a service chain can hold, bits of a report mask
+#define FP_TX_NF 1 //fast path packets go out through this NF's TX ring
+#define FP_OUT_PORT_DEFAULT 1 //output port of a flow none of whose NFs reported one
+
+#define PARK_SLOTS 4096 //pending flows that can park packets at once, per RX core
+#define PARK_DEPTH 16 //packets parked per pending flow
+#define PARK_TIMEOUT_US 1000 //parked packets fall back to the slow path after this
+#define PARK_SCAN_BUDGET 64 //parking slots checked per RX poll
+
+#define FW_SLOTS 1024 //flow timer wheel buckets per RX core, power of two
+#define FW_TICK_MS 100 //one wheel bucket, so the wheel spans ~100s
+#define FW_TICKS_PER_POLL 4 //buckets expired per RX poll at most
+#define FW_CLOSE_TICKS 10 //a pending flow that saw FIN/RST is evicted after this
+#define FW_CLASS_TCP 0
+#define FW_CLASS_UDP 1
+#define FW_CLASS_OTHER 2
+#define FW_CLASS_CLOSING 3
+#define FW_NUM_CLASS 4
+#define FP_CLOCK_SCAN 256 //GMAT entries the CLOCK hand looks at to find one victim
+#define GMAT_HIGH_WATER(cap) ((cap) - ((cap) >> 4)) //CLOCK keeps a shard below this, rte_hash cuckoo inserts start failing near full
+#define FP_TCP_FIN 0x01
+#define FP_TCP_RST 0x04
 /****************************FP Packet Structure****************************/
 typedef void (*SA)(int);
 typedef void (*SA_SNORT)(struct rte_mbuf* pkt);
 
+/*
+ * Consolidated packet action of a flow, the GMAT side of PA. rw_mask/rw_val
+ * are the modified fields compiled by PA_consolidation into a byte blend over
+ * IPv4 header bytes FP_RW_OFF..FP_RW_OFF+15 of an option-less header, see
+ * fp_rewrite. decap/encap name the tunnel templates the chain terminates and
+ * originates, see fp_execute. It shares the first cache line of its entry
+ * with seq and flag.
+ */
 typedef struct{
+	uint8_t rw_mask[FP_RW_LEN];//0xff where the byte is rewritten
+	uint8_t rw_val[FP_RW_LEN];//new byte, 0 where rw_mask is 0
+	int8_t action;//ACTION_DROP, ACTION_MODIFY, ACTION_SLOW or ACTION_NULL to forward as is
+	uint8_t decap;//tunnel id + 1 of the outer headers to strip, 0 if none
+	uint8_t encap;//tunnel id + 1 of the outer headers to push, 0 if none
+	uint8_t rw_outer;//the rewrite applies to the pushed outer header
+	uint16_t mask;//bit FIELD_* set if that header field is rewritten
+	uint8_t urt;//the flow has armed update rules, check_URT runs on its hits
+	uint8_t csum;//FP_CSUM_PRE if ip_csum/l4_csum are valid
+	uint16_t ip_csum;//RFC 1624 delta of the rewrite for the IPv4 header checksum
+	uint16_t l4_csum;//same for the TCP/UDP checksum, addresses and ports
+	uint8_t port;//output port, of the last NF that sent the flow out
+	uint8_t pad;
+} FP_CPA;
+
+typedef struct{
+	volatile uint32_t seq;//odd while a writer is updating the entry, see MAT_write_begin
+	volatile uint32_t gen;//bumped on eviction, reports tagged with another gen are stale
 	int flag;//flag == 1 means PF,flag == 0 means OP
-    int PA[4];
-    SA stateAction;
+	FP_CPA cpa;//GMAT: consolidated action of the chain
+	/* Owned by the RX core */
+	struct onvm_ft_ipv4_5tuple key;//GMAT key and signature, to delete the flow on eviction
+	uint32_t sig;
+	uint32_t last_seen;//wheel tick of the flow's last packet
+	uint32_t tw_next;//timer wheel bucket list, FIDs
+	uint32_t tw_prev;
+	uint16_t park;//1 + parking slot while the flow is pending consolidation, 0 if none
+	uint16_t tw_slot;
+	uint8_t tw_linked;
+	uint8_t tw_class;//FW_CLASS_*
+	uint8_t in_use;//the entry holds a flow, FP_RESTORED if it came from a snapshot
+	uint8_t ref;//CLOCK reference bit, set on every hit
+} __rte_cache_aligned MAT_Map;
+
+/*
+ * LMAT row: what one NF of the chain reported for a flow. Only the PA and the
+ * state actions, the rest of MAT_Map is GMAT state, so a position's rows for
+ * every FID stay small enough to allocate on lmat_chain_join.
+ */
+typedef struct{
+	volatile uint32_t seq;//see MAT_write_begin
+	int PA[4];//action, field, value and output port (-1 if none) of one NF
+	SA stateAction;
 	SA_SNORT stateAction_snort;
-	uint64_t processing_cycle;
-}MAT_Map;
-
-typedef struct{ //JYM: 目前的实现假设每个流最多往URT注册一个update规则，因此相关的state最多就一个。另外，目前state都统一用int变量表示，实际上更严格的来说应该用泛型实现。
-    int is_updated;
-    int condition_threshold;
-    int* state_address;
-    int* update_action;
+} LMAT_Row;
+
+/*
+ * Update rule: when the NF state at state compares true against operand, the
+ * LMAT row of chain position pos gets action (packet action, field, value)
+ * and the flow is consolidated again. A rule fires once.
+ */
+typedef struct{
+	const volatile void *state;
+	uint64_t operand;
+	uint8_t type;//URT_STATE_*
+	uint8_t op;//URT_CMP_*
+	uint16_t pos;
+	int action[3];
+}URT_Rule;
+
+typedef struct{
+    volatile uint32_t seq;
+    uint8_t num_rules;
+    uint8_t armed;//mask of the rules that have not fired yet
+    URT_Rule rule[URT_MAX_RULES];
 }URT_Map;
 
 typedef struct fpt{
@@ -54,6 +163,644 @@ typedef struct fpt{
 	uint64_t cycle;
 }FPt;
 
+/****************************Entry Publication****************************/
+/*
+ * GMAT/LMAT/URT entries are updated in place under a per-entry sequence lock.
+ * Writers make seq odd with a CAS (so several control-side writers serialise
+ * on the entry), update, and make it even again. Readers never block a
+ * writer: they copy the fields and retry if seq was odd or moved meanwhile.
+ */
+static inline void
+fp_seq_write_begin(volatile uint32_t *seq) {
+	uint32_t s;
+
+	for(;;){
+		s = *seq;
+		if(!(s & 1) && rte_atomic32_cmpset(seq, s, s + 1))
+			break;
+		rte_pause();
+	}
+	rte_smp_wmb();
+}
+
+static inline void
+fp_seq_write_end(volatile uint32_t *seq) {
+	rte_smp_wmb();
+	*seq = *seq + 1;
+}
+
+static inline uint32_t
+fp_seq_read_begin(const volatile uint32_t *seq) {
+	uint32_t s;
+
+	while((s = *seq) & 1)
+		rte_pause();
+	rte_smp_rmb();
+	return s;
+}
+
+static inline int
+fp_seq_read_retry(const volatile uint32_t *seq, uint32_t s) {
+	rte_smp_rmb();
+	return *seq != s;
+}
+
+#define MAT_write_begin(e) fp_seq_write_begin(&(e)->seq)
+#define MAT_write_end(e) fp_seq_write_end(&(e)->seq)
+
+/* Consistent copy of an LMAT row's PA */
+static inline void
+MAT_read_PA(const LMAT_Row *e, int PA[4]) {
+	uint32_t s;
+
+	do{
+		s = fp_seq_read_begin(&e->seq);
+		PA[0] = e->PA[0];
+		PA[1] = e->PA[1];
+		PA[2] = e->PA[2];
+		PA[3] = e->PA[3];
+	}while(fp_seq_read_retry(&e->seq, s));
+}
+
+/*
+ * Consistent copy of a GMAT entry's flag and consolidated action, returns 1
+ * if the flow takes the fast path: installed and not ACTION_SLOW.
+ */
+static inline int
+MAT_read_CPA(const MAT_Map *e, FP_CPA *cpa) {
+	uint32_t s;
+	int flag;
+
+	do{
+		s = fp_seq_read_begin(&e->seq);
+		flag = e->flag;
+		*cpa = e->cpa;
+	}while(fp_seq_read_retry(&e->seq, s));
+	return flag == 1 && cpa->action != ACTION_SLOW;
+}
+
+/****************************Checksums****************************/
+#define FP_CSUM_PRE 0x01 //the CPA's deltas were computed from the flow's key at consolidation
+
+/* 1 if every port computes IPv4 header checksums on transmit, see init_port */
+extern uint8_t fp_csum_offload;
+
+/* fp_csum_sum/fold/delta/adjust/update come from the NF library's fp_csum.h */
+
+/****************************Packet Rewrite****************************/
+static inline void
+fp_rewrite_8(uint8_t *p, const uint8_t *mask, const uint8_t *val) {
+	uint64_t d, m, v;
+
+	memcpy(&d, p, sizeof(d));
+	memcpy(&m, mask, sizeof(m));
+	memcpy(&v, val, sizeof(v));
+	d = (d & ~m) | v;
+	memcpy(p, &d, sizeof(d));
+}
+
+/*
+ * Applies a flow's compiled rewrite to an IPv4 packet. Without IP options the
+ * addresses and ports are contiguous and take one 16 byte blend, otherwise
+ * the addresses and the start of the L4 header are blended 8 bytes apart.
+ * The checksums take the flow's precomputed deltas, a rewrite of headers the
+ * GMAT key does not describe (decapsulated or pushed ones) takes them from
+ * the bytes it replaces.
+ */
+static inline void
+fp_rewrite(struct rte_mbuf *pkt, const FP_CPA *cpa, int offload) {
+	uint8_t *ip = rte_pktmbuf_mtod_offset(pkt, uint8_t *, sizeof(struct ether_hdr));
+	uint16_t ihl = (ip[0] & 0x0f) * 4;
+	uint32_t old_ip = 0, old_l4 = 0, upd_ip;
+
+	if(unlikely(ihl < sizeof(struct ipv4_hdr)
+			|| rte_pktmbuf_data_len(pkt) < sizeof(struct ether_hdr) + ihl + 8))
+		return;
+	if(!(cpa->csum & FP_CSUM_PRE)){
+		old_ip = fp_csum_sum(ip + FP_RW_OFF, 8);
+		old_l4 = old_ip + fp_csum_sum(ip + ihl, 4);
+	}
+#ifdef RTE_MACHINE_CPUFLAG_SSE2
+	if(likely(ihl == sizeof(struct ipv4_hdr))){
+		__m128i m = _mm_loadu_si128((const __m128i *)cpa->rw_mask);
+		__m128i v = _mm_loadu_si128((const __m128i *)cpa->rw_val);
+		__m128i d = _mm_loadu_si128((const __m128i *)(ip + FP_RW_OFF));
+
+		_mm_storeu_si128((__m128i *)(ip + FP_RW_OFF), _mm_or_si128(_mm_andnot_si128(m, d), v));
+	}else
+#endif
+	{
+		fp_rewrite_8(ip + FP_RW_OFF, cpa->rw_mask, cpa->rw_val);
+		fp_rewrite_8(ip + ihl, cpa->rw_mask + 8, cpa->rw_val + 8);
+	}
+	if(likely(cpa->csum & FP_CSUM_PRE)){
+		fp_csum_update(pkt, ip, ihl, cpa->ip_csum, cpa->l4_csum, offload);
+		return;
+	}
+	upd_ip = fp_csum_sum(ip + FP_RW_OFF, 8);
+	fp_csum_update(pkt, ip, ihl, fp_csum_delta(old_ip, upd_ip),
+			fp_csum_delta(old_l4, upd_ip + fp_csum_sum(ip + ihl, 4)), offload);
+}
+
+/****************************Tunnel Encap/Decap****************************/
+#define FP_OUTER_PROTO (sizeof(struct ether_hdr) + 9) //next protocol of a template's outer IPv4 header
+#define FP_OUTER_DPORT (sizeof(struct ether_hdr) + sizeof(struct ipv4_hdr) + 2) //UDP destination port
+#define FP_VXLAN_SPORT_BASE 0xc000 //outer UDP source ports are 0xc000 | inner RSS hash, RFC 7348
+
+/* NFs' tunnel templates, MZ_TUNNEL_INFO */
+extern struct onvm_tunnel_table *fp_tunnels;
+
+/*
+ * Strips the outer headers of tunnel t in place. An Ethernet-less inner packet
+ * (GRE) gets the outer Ethernet header moved up in front of it. Returns -1,
+ * leaving the packet alone, unless it carries t's outer protocol and port.
+ */
+static inline int
+fp_decap(struct rte_mbuf *pkt, const struct onvm_tunnel *t) {
+	uint8_t *d = rte_pktmbuf_mtod(pkt, uint8_t *);
+	uint16_t strip = t->inner_l2 ? t->len : t->len - sizeof(struct ether_hdr);
+
+	if(unlikely(rte_pktmbuf_data_len(pkt) < strip + sizeof(struct ether_hdr)
+			|| d[sizeof(struct ether_hdr)] != t->hdr[sizeof(struct ether_hdr)]
+			|| d[FP_OUTER_PROTO] != t->hdr[FP_OUTER_PROTO]
+			|| (t->udp && memcmp(d + FP_OUTER_DPORT, t->hdr + FP_OUTER_DPORT, 2) != 0)))
+		return -1;
+	if(!t->inner_l2)
+		memmove(d + strip, d, sizeof(struct ether_hdr));
+	rte_pktmbuf_adj(pkt, strip);
+	return 0;
+}
+
+/*
+ * Pushes tunnel t's outer headers into the headroom, replacing the packet's
+ * Ethernet header unless the tunnel carries it (VXLAN). Only the lengths, the
+ * outer IPv4 checksum, from the template's precomputed sum unless the NIC
+ * computes it, and the UDP source port are filled in per packet. Returns -1
+ * without enough headroom.
+ */
+static inline int
+fp_encap(struct rte_mbuf *pkt, const struct onvm_tunnel *t) {
+	uint16_t push = t->inner_l2 ? t->len : t->len - sizeof(struct ether_hdr);
+	uint8_t *d = (uint8_t *)rte_pktmbuf_prepend(pkt, push);
+	struct ipv4_hdr *ip;
+	struct udp_hdr *udp;
+	uint16_t ip_len;
+	uint32_t sum;
+
+	if(unlikely(d == NULL))
+		return -1;
+	rte_memcpy(d, t->hdr, t->len);
+	ip_len = rte_pktmbuf_pkt_len(pkt) - sizeof(struct ether_hdr);
+	ip = (struct ipv4_hdr *)(d + sizeof(struct ether_hdr));
+	ip->total_length = rte_cpu_to_be_16(ip_len);
+	if(fp_csum_offload){
+		ip->hdr_checksum = 0;
+		pkt->ol_flags |= PKT_TX_IPV4 | PKT_TX_IP_CKSUM;
+		pkt->l2_len = sizeof(struct ether_hdr);
+		pkt->l3_len = sizeof(struct ipv4_hdr);
+	}else{
+		sum = t->ip_csum + ip->total_length;
+		ip->hdr_checksum = (uint16_t)~fp_csum_fold(sum);
+	}
+	if(t->udp){
+		udp = (struct udp_hdr *)(ip + 1);
+		udp->src_port = rte_cpu_to_be_16(FP_VXLAN_SPORT_BASE | (pkt->hash.rss & 0x3fff));
+		udp->dgram_len = rte_cpu_to_be_16(ip_len - sizeof(struct ipv4_hdr));
+		udp->dgram_cksum = 0;
+	}
+	return 0;
+}
+
+/*
+ * Runs a flow's consolidated action on one packet in chain order: pop the
+ * tunnel it arrived in, rewrite, push the tunnel it leaves in. Fields the
+ * chain modified after encapsulating are rewritten in the new outer header.
+ * Returns -1 if a tunnel step failed, the packet is then to be dropped.
+ */
+static inline int
+fp_execute(struct rte_mbuf *pkt, const FP_CPA *cpa) {
+	if(cpa->decap && fp_decap(pkt, &fp_tunnels->t[cpa->decap - 1]) != 0)
+		return -1;
+	/* ol_flags only reach the outermost header */
+	if(cpa->mask && !cpa->rw_outer)
+		fp_rewrite(pkt, cpa, fp_csum_offload && !cpa->encap);
+	if(cpa->encap && fp_encap(pkt, &fp_tunnels->t[cpa->encap - 1]) != 0)
+		return -1;
+	if(cpa->mask && cpa->rw_outer)
+		fp_rewrite(pkt, cpa, fp_csum_offload);
+	return 0;
+}
+
+/****************************Parking Buffer****************************/
+/*
+ * Packets of a flow that arrive after its first packet but before its GMAT
+ * entry is installed are parked here instead of taking the slow path again.
+ * The pool belongs to one RX core, so it needs no synchronisation.
+ */
+typedef struct{
+	uint32_t FID;
+	uint16_t count;
+	uint64_t deadline;
+	struct rte_mbuf *pkts[PARK_DEPTH];
+}Park_Slot;
+
+typedef struct park_pool{
+	uint16_t free_count;
+	uint16_t active_count;
+	uint16_t scan;
+	uint16_t free_list[PARK_SLOTS];
+	uint16_t active[PARK_SLOTS];
+	uint16_t active_pos[PARK_SLOTS];//slot -> position in active[], for O(1) release
+	uint64_t timeout_cycles;
+	Park_Slot slots[PARK_SLOTS];
+}Park_Pool;
+
+Park_Pool *
+park_pool_create(void);
+
+uint16_t
+park_slot_get(Park_Pool *pool, uint32_t FID);
+
+void
+park_slot_put(Park_Pool *pool, uint16_t park);
+
+static inline Park_Slot *
+park_slot(Park_Pool *pool, uint16_t park) {
+	return &pool->slots[park - 1];
+}
+
+/****************************Flow Aging****************************/
+/*
+ * Each RX core ages the GMAT entries of its own shard with a hashed timer
+ * wheel. A packet only refreshes last_seen; an entry is linked in the bucket
+ * of its deadline and, when that bucket comes up, is evicted if it really
+ * went idle or moved to the bucket of its new deadline otherwise. So the per
+ * packet cost is one store and every entry is touched about once per timeout.
+ */
+typedef struct flow_wheel{
+	uint16_t shard;
+	uint32_t hand;//CLOCK hand, shard index
+	uint32_t now;//current tick, refreshed by every poll
+	uint32_t cur;//next tick to expire
+	uint64_t base;
+	uint64_t tick_cycles;
+	uint32_t timeout[FW_NUM_CLASS];//idle timeout per class, in ticks
+	uint32_t head[FW_SLOTS];
+}Flow_Wheel;
+
+Flow_Wheel *
+flow_wheel_create(uint16_t shard);
+
+void
+flow_wheel_link(Flow_Wheel *wheel, uint32_t FID, uint32_t deadline);
+
+void
+flow_wheel_unlink(Flow_Wheel *wheel, uint32_t FID);
+
+/* Detach and return the list of bucket tick, FID_NULL if it is empty */
+uint32_t
+flow_wheel_take(Flow_Wheel *wheel, uint32_t tick);
+
+static inline uint32_t
+flow_deadline(Flow_Wheel *wheel, MAT_Map *entry) {
+	return entry->last_seen + wheel->timeout[entry->tw_class];
+}
+
+/*
+ * Deletes the flow's GMAT key and clears its entry, then tells the LMAT
+ * consolidation side, which clears LMAT/OP_LMAT/FP_LMAT/URT and notifies the
+ * NFs. The notice goes through incoming_lmat_queue so it is ordered before any
+ * report for a new flow reusing the FID, and the entry's gen is bumped so
+ * reports the NFs still hold for the old flow are dropped whenever they come
+ * in. Only the RX core owning the FID's
+ * shard may call it. Returns -1, with nothing evicted, if no notice could be
+ * allocated.
+ */
+int
+GMAT_evict(uint32_t FID);
+
+/* Consolidation side of GMAT_evict */
+void
+GMAT_flow_cleanup(uint32_t FID);
+
+/****************************Service Chain****************************/
+/*
+ * The NFs whose LMAT reports are consolidated into a flow's GMAT entry,
+ * learned as NFs become ready. Chains forward service by service in id
+ * order, so an NF takes position service_id - 1 whatever order the NFs
+ * start in, and PA_consolidation folds their actions in chain order.
+ * Instances of one service share its position. The LMAT rows of a position
+ * are allocated the first time it is used, positions never used have none.
+ * When the last instance stops the position clears its bit in live and
+ * posts IS_LEAVE, see lmat_chain_leave. The rows stay for the next NF of that
+ * service, so the consolidation side never reads freed memory.
+ *
+ * Only the NF status loop writes the chain, the consolidation side reads
+ * live and pos[] and sees LMAT[p] allocated before p shows up in live.
+ *
+ * sa[]/sa_pkt[] are the state actions an NF's module exported, bound into
+ * the LMAT rows of its position as its reports come in.
+ */
+struct lmat_chain{
+	volatile uint32_t live;//mask of positions with a running NF
+	uint16_t len;//1 + highest position ever used, LMAT[p] of unused p is NULL
+	uint16_t refs[FP_MAX_CHAIN];//running instances at a position
+	SA sa[FP_MAX_CHAIN];
+	SA_SNORT sa_pkt[FP_MAX_CHAIN];
+	volatile uint8_t pkt_sa;//1 + position of the NF whose SA reads the packet, 0 if none
+	volatile uint8_t pos[MAX_NFS];//1 + position of an instance id, 0 if not in the chain
+};
+
+extern struct lmat_chain lmat_chain;
+extern LMAT_Row *LMAT[FP_MAX_CHAIN];
+
+/*
+ * Adds a ready NF to its service's position in the chain with the state
+ * actions of its module, either may be NULL. Another instance of the service
+ * joins the position of the first one. -1 if the service id is beyond
+ * FP_MAX_CHAIN or out of memory.
+ */
+int
+lmat_chain_join(uint16_t instance_id, uint16_t service_id, SA sa, SA_SNORT sa_pkt);
+
+/*
+ * dlopens an NF's state action module and looks up ONVM_SA_SYMBOL and
+ * ONVM_SA_PKT_SYMBOL. A module is never unloaded, LMAT rows and queued
+ * jobs may still point into it after its NF stopped. Returns -1 if the
+ * module cannot be loaded or exports neither.
+ */
+int
+SA_module_load(const char *path, SA *sa, SA_SNORT *sa_pkt);
+
+/*
+ * Removes a stopped NF from the chain. When it was the last instance at its
+ * position, an IS_LEAVE notice on incoming_lmat_queue has the consolidation
+ * side install the pending flows whose reports now cover lmat_chain.live;
+ * without a notice buffer they wait for the slow path timeout instead.
+ */
+void
+lmat_chain_leave(uint16_t instance_id);
+
+/****************************RX Burst Grouping****************************/
+/*
+ * An RX burst is split into the flows it carries before any GMAT access, so
+ * each flow is looked up, refreshed and has its action read once per burst
+ * however many of its packets the burst holds.
+ */
+#define FP_GROUP_SLOTS 64 //open addressing slots per burst, at least twice PACKET_READ_SIZE
+
+typedef struct{
+	struct onvm_ft_ipv4_5tuple key;
+	uint32_t rss;
+	uint16_t first;//burst index of the flow's first packet
+	uint8_t keyed;//0 for non-IPv4 packets, which are never grouped
+	uint8_t stale;//evicted mid-burst, the next packet looks the flow up again
+	uint8_t lent;//1 + the steal slot the group is lent in, 0 if acted on here
+	int is_new;//consumed by the first packet processed
+	int flag;//entry flag and action as of the burst
+	uint32_t FID;
+	MAT_Map *entry;
+	FP_CPA cpa;
+	uint32_t pkts;//packets and bytes of the flow in the burst
+	uint32_t bytes;
+}RX_Flow_Group;
+
+static inline int
+fp_key_equal(const struct onvm_ft_ipv4_5tuple *a, const struct onvm_ft_ipv4_5tuple *b) {
+	return a->src_addr == b->src_addr && a->dst_addr == b->dst_addr
+		&& a->src_port == b->src_port && a->dst_port == b->dst_port
+		&& a->proto == b->proto;
+}
+
+/****************************State Action Workers****************************/
+/*
+ * With -w N the state actions of fast path packets leave the RX cores. Every
+ * live chain position of a packet's flow is one job, always for worker
+ * pos % N, so an NF's state is only written by one worker while the NFs of a
+ * chain run side by side. Each RX core owns a single producer/single consumer
+ * ring to each worker and stages jobs per worker, SA_BURST at a time. A job of
+ * an SA reading the packet holds a reference on the mbuf which the worker drops
+ * when done, so the RX core forwards the packet at once and never joins. A full
+ * ring stalls the RX core rather than letting it run the worker's SAs.
+ */
+#define SA_RING_SIZE 1024
+#define SA_BURST 32
+#define SA_JOB_POOL_NAME "SA_JOB_POOL"
+#define SA_RING_NAME "SA_RING_%u_%u"
+
+struct sa_job{
+	struct rte_mbuf *pkt;//referenced while queued, NULL unless the SA reads the packet
+	uint32_t FID;
+	uint32_t gen;//of the FID when the job was staged, the job is dropped once it moved on
+	uint16_t pos;
+	uint8_t urt;//check the flow's update rules once the SA ran
+	uint8_t pad;
+};
+
+/****************************Pipelined Action Stage****************************/
+/*
+ * With -a N the RX cores only classify: they group the burst, look up the
+ * GMAT, count, park and age flows, then hand every fast path packet with a
+ * copy of its flow's CPA to action core FID % N. The action cores run the
+ * state actions, rewrites and TX. A copy and not the entry because the RX
+ * core may evict the flow before the descriptor is taken. Each RX core owns
+ * a single producer/single consumer ring to each action core, so a flow's
+ * packets stay in order. A full ring drops the packet on the RX core.
+ */
+#define FP_PIPE_RING_SIZE 1024
+#define FP_PIPE_BURST 32
+#define FP_PIPE_POOL_NAME "FP_PIPE_POOL"
+#define FP_PIPE_RING_NAME "FP_PIPE_%u_%u"
+
+struct fp_desc{
+	struct rte_mbuf *pkt;
+	uint32_t FID;
+	int8_t snort_seq;
+	uint8_t pad[3];
+	FP_CPA cpa;
+};
+
+/****************************RX Work Stealing****************************/
+/*
+ * With -b an RX core whose last FP_STEAL_BURSTS bursts were all full lends
+ * whole fast path flow groups of its next bursts to the other RX cores. The
+ * owner still groups and looks the packets up, its GMAT shard keeps a single
+ * writer; a lent group waits in one of its FP_STEAL_SLOTS slots with a copy
+ * of the flow's CPA until an RX core that received nothing in its round takes
+ * it, runs the actions and puts the packets on the TX ring. A slot holds one
+ * flow. Before it acts on, lends or evicts a flow that still has a slot out,
+ * the owner takes the slot back if no core took it yet, else waits for the
+ * thief, so a flow's packets reach the TX ring in order.
+ */
+#define FP_STEAL_SLOTS 4
+#define FP_STEAL_BURSTS 2
+#define FP_STEAL_FREE 0
+#define FP_STEAL_READY 1 //filled by the owner, free to take
+#define FP_STEAL_TAKEN 2 //being run by a thief or taken back by the owner
+
+/****************************Per RX lcore Stats****************************/
+/* Written only by the owning RX lcore, one cache line each. With -a the
+ * action lcores follow the RX lcores, action core a at num_rx_threads + a. */
+typedef struct{
+	uint64_t fp_total_cont;
+	uint64_t op_total_cont;
+	uint64_t gmat_used;//flows in the RX core's GMAT shard
+	uint64_t gmat_full;//new flows left uncached, no CLOCK victim was found
+	uint64_t evict_idle;
+	uint64_t evict_close;//TCP FIN/RST
+	uint64_t evict_clock;//replaced to make room for a new flow
+	uint64_t sa_jobs;//state actions handed to the workers
+	uint64_t sa_stall;//spins waiting for space in a worker's ring
+	uint64_t sa_inline;//run on the RX core after all, the worker did not drain its ring
+	uint64_t tunnel_err;//fast path packets dropped, not the flow's tunnel or no headroom to encapsulate
+	uint64_t pipe_full;//fast path packets dropped, the action core's ring was full
+	uint64_t steal_lent;//packets lent to the other RX cores
+	uint64_t steal_run;//packets of other RX cores run here
+	uint64_t steal_back;//lent packets nobody took, run by the owner after all
+	uint64_t steal_wait;//spins waiting for a thief to finish a flow's slot
+	uint64_t fp_drop[RTE_MAX_ETHPORTS];//packets of ACTION_DROP flows freed on the RX core, by input port
+} __rte_cache_aligned FP_RX_Stats;
+
+extern FP_RX_Stats fp_rx_stats[];
+
+/****************************Per lcore Cycle Accounting****************************/
+/*
+ * TSC cycles each lcore spends per stage, always on: a handful of rdtsc per
+ * burst. Only the lcore itself writes its slot; the stats thread turns the
+ * deltas into cycles per packet (per installed flow for the consolidation
+ * stages) every period. FP_CYC_LMAT_WAIT is not work but the time from a
+ * flow's first packet to its GMAT install.
+ */
+#define FP_CYC_GROUP 0 //RX: FID extraction and burst grouping
+#define FP_CYC_LOOKUP 1 //RX: GMAT lookup, touch, reclaim, flow counters
+#define FP_CYC_ACTION 2 //RX: fast path actions, parking, slow path hand off; action cores: actions
+#define FP_CYC_ENQUEUE 3 //RX: TX ring and NF queue enqueue; action cores: TX ring or port
+#define FP_CYC_TX_BATCH 4 //TX: NF TX queue dequeue and processing
+#define FP_CYC_TX_FLUSH 5 //TX: port and NF queue flush
+#define FP_CYC_CONSOLIDATE 6 //LMAT consolidation and GMAT install
+#define FP_CYC_LMAT_WAIT 7
+#define FP_NUM_CYC 8
+
+typedef struct{
+	uint64_t cycles[FP_NUM_CYC];
+	uint64_t pkts;//packets through the RX or TX stages
+	uint64_t flows;//flows installed, for the consolidation stages
+} __rte_cache_aligned FP_Cycle_Stats;
+
+extern FP_Cycle_Stats fp_cycle_stats[];
+
+/****************************GMAT Flow Cache****************************/
+/*
+ * GMAT is an rte_hash backed onvm_ft keyed on the full IPv4 5-tuple, the NIC
+ * RSS hash is used as the precomputed signature and every lookup compares the
+ * full key. The MAT_Map of a flow lives at its hash index.
+ *
+ * There is one GMAT shard per RX queue. RSS keeps a flow on one queue, so each
+ * shard's rte_hash only ever sees its own RX lcore and needs no locking; the
+ * consolidation side reads and fills entries by FID only. The FID is
+ * (shard << GMAT_shard_bits) | index, a global index for LMAT/URT/OP_LMAT_bef_cons.
+ */
+extern struct onvm_ft *GMAT[];
+extern uint32_t GMAT_shard_bits;
+
+static inline MAT_Map *
+GMAT_entry(uint32_t FID) {
+	return (MAT_Map *)onvm_ft_get_data(GMAT[FID >> GMAT_shard_bits],
+		FID & ((1U << GMAT_shard_bits) - 1));
+}
+
+/****************************Flow Counters****************************/
+/*
+ * Counters of every packet the RX core saw of a GMAT flow, fast or slow
+ * path. They live in an array per shard next to the GMAT instead of in
+ * MAT_Map, so counting does not grow the entry past its two lines. At 32
+ * bytes, neighbouring FIDs share a line; that is harmless as the shard's RX
+ * lcore is the only writer of all of them. The RX core adds a whole burst of
+ * a flow at once; the stats thread reads them without locking when it ranks
+ * the top flows. pkts == 0 means the FID holds no counted flow.
+ */
+#define FP_TOP_FLOWS 10
+
+typedef struct{
+	uint64_t pkts;
+	uint64_t bytes;
+	uint64_t first_tsc;
+	uint64_t last_tsc;
+} FP_Flow_Ctr;
+
+extern FP_Flow_Ctr *GMAT_ctr_shard[];
+
+static inline FP_Flow_Ctr *
+GMAT_ctr(uint32_t FID) {
+	return &GMAT_ctr_shard[FID >> GMAT_shard_bits][FID & ((1U << GMAT_shard_bits) - 1)];
+}
+
+static inline void
+fp_flow_count(uint32_t FID, uint32_t pkts, uint32_t bytes, uint64_t tsc) {
+	FP_Flow_Ctr *ctr = GMAT_ctr(FID);
+
+	if(ctr->pkts == 0)
+		ctr->first_tsc = tsc;
+	ctr->bytes += bytes;
+	ctr->last_tsc = tsc;
+	ctr->pkts += pkts;
+}
+
+int
+GMAT_init(uint8_t shards);
+
+uint32_t
+GMAT_lookup_FID(uint16_t shard, struct rte_mbuf *pkt, int *is_new);
+
+/****************************Warm Restart****************************/
+/*
+ * With -S the master thread checkpoints the installed GMAT entries (key,
+ * signature, shard and CPA) every -k seconds and once more on shutdown. It
+ * walks each shard's hash, so only live flows are visited, and writes just
+ * the records found to a temporary file it renames over the old one. A manager started with the same file, -q and RSS key adds the
+ * flows back to their shards before the RX cores start, so they stay on the
+ * fast path across the restart.
+ *
+ * Update rules are not saved, their state lives in the old process, and
+ * neither are tunnel flows, whose template ids the NFs register anew. The LMAT
+ * rows of restored flows hold no state actions until the NFs rejoin the chain,
+ * lmat_chain_join then binds theirs.
+ */
+#define FP_SNAP_MAGIC "ONVMGMAT"
+#define FP_SNAP_VERSION 4
+#define FP_RESTORED 2 //in_use of an entry restored from a snapshot
+
+typedef struct{
+	char magic[8];
+	uint32_t version;
+	uint32_t rec_size;//sizeof(FP_Snap_Rec)
+	uint32_t shards;
+	uint32_t shard_bits;
+	uint64_t count;
+	uint64_t taken;//time() of the checkpoint
+} FP_Snap_Hdr;
+
+typedef struct{
+	struct onvm_ft_ipv4_5tuple key;
+	uint32_t sig;
+	uint16_t shard;
+	uint8_t tw_class;
+	uint8_t pad;
+	FP_CPA cpa;
+} FP_Snap_Rec;
+
+/* Checkpoints the installed flows to path, returns how many or -1 */
+int
+GMAT_snapshot_save(const char *path);
+
+/*
+ * Adds the flows of a snapshot back to the GMAT, installed. Call after
+ * GMAT_init and before the RX cores start. Returns how many, -1 if the file
+ * is missing or does not match this build and configuration.
+ */
+int
+GMAT_snapshot_restore(const char *path);
+
 
  __attribute__ ((gnu_inline))
 inline unsigned char *
@@ -72,7 +819,7 @@ inline void
 Pkt_View(struct rte_mbuf ** bufs, int nb_rx);
 
 void
-print_PA(MAT_Map LMAT[], int FID);
+print_PA(LMAT_Row LMAT[], int FID);
 
 uint32_t
 NF_Get_FID_Chain(struct rte_mbuf * bufs);
@@ -80,12 +827,6 @@ NF_Get_FID_Chain(struct rte_mbuf * bufs);
 uint32_t
 delay(uint32_t x , uint32_t control);
 
-void
-PktTag(struct rte_mbuf* pkt);
-
-void
-Modify_FID(int Pkt_Num, struct rte_mbuf ** bufs);
-
 uint32_t
 Hash_FID(unsigned char * d);
 
@@ -96,28 +837,77 @@ void
 Modify(uint16_t Field, int Value, struct rte_mbuf * b[],int Pkt_ID);
 
 void
-LMAT_add_rule(MAT_Map LMAT[], int FID, int packet_action, int field, int value, SA stateaction);
+LMAT_add_rule(LMAT_Row LMAT[], int FID, int packet_action, int field, int value, int port, SA stateaction);
 
 void
-LMAT_add_rule_snort(MAT_Map LMAT[], int FID, int packet_action, int field, int value, SA_SNORT stateaction);
+LMAT_add_rule_snort(LMAT_Row LMAT[], int FID, int packet_action, int field, int value, int port, SA_SNORT stateaction);
 
 void
-execute_SA(MAT_Map LMAT[], int FID);
+execute_SA(LMAT_Row LMAT[], int FID);
 
 void
-execute_SA_snort(MAT_Map LMAT[], int FID, struct rte_mbuf* pkt);
-
+execute_SA_snort(LMAT_Row LMAT[], int FID, struct rte_mbuf* pkt);
+
+/*
+ * Adds an update rule to FID, see URT_Rule. Installed flows start checking
+ * it on their next fast path hit. Returns the rule index, -1 if FID already
+ * has URT_MAX_RULES rules.
+ */
+int
+URT_add_rule(int FID, uint16_t pos, const volatile void *state, uint8_t type, uint8_t op,
+             uint64_t operand, const int action[3]);
+
+/* One int state compared with >, for chain position 0 */
 void
 register_URT(int FID, int* state_address, int condition_threshold, int update_action[3]);
 
-int*
-PA_consolidation(int FID);
+/*
+ * Folds the PAs of every NF's LMAT row for FID into cpa, no allocation. A
+ * drop anywhere in the chain wins, otherwise later NFs override the fields
+ * earlier ones modified and the result is compiled into cpa's rewrite. A
+ * decapsulation discards the modifies of the headers it strips, or cancels
+ * the encapsulation of the same tunnel earlier in the chain. Nested tunnels,
+ * modifies both before and after an encapsulation and port modifies of an
+ * outer header without UDP (GRE) give ACTION_SLOW.
+ * Returns cpa->action.
+ */
+int
+PA_consolidation(int FID, FP_CPA *cpa);
+
+/*
+ * Evaluates FID's armed update rules and applies those that match. Called on
+ * fast path hits of flows whose CPA has urt set, gen is the FID's generation
+ * the hit was seen with: nothing fires once the flow was evicted. Returns the
+ * number of rules fired, the GMAT entry holds the new action if it is not 0.
+ */
+int
+check_URT(int FID, uint32_t gen);
 
 void
-check_URT(MAT_Map LMAT[], int FID);
+SA_parallel_execution(int FID, int snort_seq, struct rte_mbuf* pkt);
 
+/*
+ * Creates the job pool and the rings from every RX core to every worker.
+ * Returns 0 on success.
+ */
+int
+SA_workers_init(uint8_t rx_threads, uint8_t workers);
+
+/*
+ * Stages one job per live chain position of FID for the workers, the SA of
+ * position snort_seq gets pkt. The workers check FID's update rules after
+ * its SAs when urt is set, and drop the jobs if FID is no longer at gen.
+ */
 void
-SA_parallel_execution(int FID, int snort_seq, struct rte_mbuf* pkt);
+SA_dispatch(uint16_t rx_id, int FID, uint32_t gen, int snort_seq, struct rte_mbuf* pkt, uint8_t urt);
+
+/* Hands the jobs rx_id staged so far to the workers */
+void
+SA_dispatch_flush(uint16_t rx_id);
+
+/* Runs the jobs queued for worker by all RX cores, returns how many */
+unsigned
+SA_worker_poll(uint8_t worker);
 
 
 void *thread1(void * FID);
@@ -134,14 +924,23 @@ void *thread_snort1(void * pkt);
 
 
 
+/* Consolidates FID straight into its GMAT entry and marks it fast path, unless it was evicted since gen */
+void
+add_rule_to_GMAT(int FID, uint32_t gen);
+
+/*
+ * Consolidates the LMAT rows of FID over the live chain positions and installs
+ * the result in GMAT. Called as soon as OP_LMAT_bef_cons covers lmat_chain.live,
+ * gen is the generation of the reports.
+ */
 void
-add_rule_to_GMAT(int FID, int *cpa);
+GMAT_consolidate(int FID, uint32_t gen);
 
 // void
 // execute_GMAT_rule(int FID, int CPA[]);
 
 void
-execute_GMAT_rule(int FID, int CPA[], int snort_seq, struct rte_mbuf* pkt);
+execute_GMAT_rule(int FID, FP_CPA *cpa, int snort_seq, struct rte_mbuf* pkt);
 
 void
 NF1_state_action(int FID);
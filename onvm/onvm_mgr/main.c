@@ -60,14 +60,6 @@
 
 /****************************FP Global Variables****************************/
 
-int LMAT_bef_cons[(NUM_OF_NF)+1][6];
-uint32_t hash_fid;
-int cpa[4];
-int *tmp_cpa;
-uint64_t cyc_start, cyc_end;
-uint64_t cyc_start_1, cyc_end_1;
-uint64_t cyc_start_2, cyc_end_2;
-uint64_t cyc_start_3, cyc_end_3;
 uint64_t hz;
 /****************************FP Snort Variables****************************/
 int file_line;      /* current line being processed in the rules file */
@@ -77,7 +69,7 @@ Rule *PassList;     /* List of Pass Rules */
 Rule *LogList;      /* List of Log Rules */
 Rule *AlertList;    /* List of Alert Rules */
 
-pthread_t thread[NUM_OF_NF]; //threads
+pthread_t thread[FP_MAX_CHAIN]; //threads
 
 FILE *cyc, *fid, *num;
 
@@ -110,6 +102,7 @@ master_thread_main(void) {
         uint16_t i;
         int shutdown_iter_count;
         const unsigned sleeptime = global_stats_sleep_time;
+        unsigned snapshot_wait = 0;
 
         RTE_LOG(INFO, APP, "Core %d: Running master thread\n", rte_lcore_id());
 
@@ -125,6 +118,13 @@ master_thread_main(void) {
 				onvm_nf_check_status();
                 if (stats_destination != ONVM_STATS_NONE)
                         onvm_stats_display_all(sleeptime);
+                /* Checkpoints have their own period, not every stats tick */
+                snapshot_wait += sleeptime;
+                if (fp_snapshot_path != NULL && snapshot_wait >= fp_snapshot_interval) {
+                        snapshot_wait = 0;
+                        if (GMAT_snapshot_save(fp_snapshot_path) < 0)
+                                RTE_LOG(WARNING, APP, "Cannot write GMAT snapshot %s\n", fp_snapshot_path);
+                }
         }
 
 		
@@ -140,6 +140,13 @@ master_thread_main(void) {
         /* Stop all RX and TX threads */
         worker_keep_running = 0;
 
+        /* Last checkpoint, the RX threads no longer change the GMAT */
+        if (fp_snapshot_path != NULL) {
+                rte_eal_mp_wait_lcore();
+                if (GMAT_snapshot_save(fp_snapshot_path) < 0)
+                        RTE_LOG(WARNING, APP, "Cannot write GMAT snapshot %s\n", fp_snapshot_path);
+        }
+
         /* Tell all NFs to stop */
         for (i = 0; i < MAX_NFS; i++) {
                 if (nfs[i].info == NULL) {
@@ -174,10 +181,11 @@ master_thread_main(void) {
 static int
 rx_thread_main(void *arg) {
         uint16_t i, rx_count;
+        unsigned round_count;
         struct rte_mbuf *pkts[PACKET_READ_SIZE];
         struct thread_info *rx = (struct thread_info*)arg;
 		struct rte_ring *tx_ring;
-		tx_ring = rte_ring_lookup(get_tx_queue_name(NUM_OF_NF));
+		tx_ring = rte_ring_lookup(get_tx_queue_name(FP_TX_NF));
 
 		
         RTE_LOG(INFO,
@@ -187,10 +195,12 @@ rx_thread_main(void *arg) {
                 rx->queue_id);
         for (; worker_keep_running;) {
                 /* Read ports */
+                round_count = 0;
                 for (i = 0; i < ports->num_ports; i++) {
                         rx_count = rte_eth_rx_burst(ports->id[i], rx->queue_id, \
                                         pkts, PACKET_READ_SIZE);
                         ports->rx_stats.rx[ports->id[i]] += rx_count;
+                        round_count += rx_count;
                         /* Now process the NIC packets read */
                         if (likely(rx_count > 0)) {
                                 // If there is no running NF, we drop all the packets of the batch.
@@ -203,6 +213,33 @@ rx_thread_main(void *arg) {
                                 }
                         }
                 }
+
+                /* Release parked packets of flows that got installed or timed out */
+                onvm_pkt_park_poll(rx, tx_ring);
+
+                /* Evict flows that went idle */
+                onvm_pkt_flow_age_poll(rx, tx_ring);
+
+                /* Nothing came in, help the RX cores that lend out flow groups */
+                if (fp_steal && round_count == 0)
+                        onvm_pkt_steal(rx, tx_ring);
+
+                /* Hand the fast path packets staged this round to the action cores */
+                if (num_action_lcores)
+                        onvm_pkt_pipe_flush(rx);
+
+                /* Send what the fast path buffered per port this round */
+                if (rx->port_tx_buf != NULL)
+                        onvm_pkt_flush_all_ports(rx);
+
+                /* Hand the state actions staged in this round to the workers */
+                if (num_sa_workers)
+                        SA_dispatch_flush(rx->queue_id);
+
+                /* Install GMAT entries for pending flows whose LMATs are all in.
+                 * incoming_lmat_queue is single consumer, so only queue 0 drains it. */
+                if (!fp_ctrl_lcore && rx->queue_id == 0)
+                        onvm_nf_check_LMAT();
         }
 
         RTE_LOG(INFO, APP, "Core %d: RX thread done\n", rte_lcore_id());
@@ -211,12 +248,78 @@ rx_thread_main(void *arg) {
 }
 
 
+/*
+ * Control thread drains the NFs' LMAT reports, consolidates them and
+ * publishes GMAT entries so that the RX threads only do lookups and
+ * action execution.
+ */
+static int
+ctrl_thread_main(__attribute__((unused)) void *arg) {
+        RTE_LOG(INFO, APP, "Core %d: Running control thread for LMAT consolidation\n", rte_lcore_id());
+
+        for (; worker_keep_running;) {
+                onvm_nf_check_LMAT();
+        }
+
+        RTE_LOG(INFO, APP, "Core %d: Control thread done\n", rte_lcore_id());
+
+        return 0;
+}
+
+
+/*
+ * State action worker, runs the state actions the RX threads hand over for
+ * its share of the chain positions.
+ */
+static int
+sa_worker_main(void *arg) {
+        uint8_t worker = (uint8_t)(uintptr_t)arg;
+
+        RTE_LOG(INFO, APP, "Core %d: Running state action worker %u\n", rte_lcore_id(), worker);
+
+        for (; worker_keep_running;) {
+                SA_worker_poll(worker);
+        }
+
+        RTE_LOG(INFO, APP, "Core %d: State action worker %u done\n", rte_lcore_id(), worker);
+
+        return 0;
+}
+
+
+/*
+ * Action core of the pipeline, runs the fast path actions of the packets the
+ * RX threads classified for it and sends them out.
+ */
+static int
+action_thread_main(void *arg) {
+        struct thread_info *act = (struct thread_info*)arg;
+        struct rte_ring *tx_ring = rte_ring_lookup(get_tx_queue_name(FP_TX_NF));
+
+        RTE_LOG(INFO, APP, "Core %d: Running action thread %u\n", rte_lcore_id(),
+                (unsigned)(act->queue_id - num_rx_threads));
+
+        for (; worker_keep_running;) {
+                onvm_pkt_process_action(act, tx_ring);
+                if (act->port_tx_buf != NULL)
+                        onvm_pkt_flush_all_ports(act);
+        }
+
+        RTE_LOG(INFO, APP, "Core %d: Action thread %u done\n", rte_lcore_id(),
+                (unsigned)(act->queue_id - num_rx_threads));
+
+        return 0;
+}
+
+
 static int
 tx_thread_main(void *arg) {
         struct onvm_nf *nf;
         unsigned i, tx_count;
         struct rte_mbuf *pkts[PACKET_READ_SIZE];
         struct thread_info* tx = (struct thread_info*)arg;
+        FP_Cycle_Stats *cyc = &fp_cycle_stats[rte_lcore_id()];
+        uint64_t t0, t1, t2;
 
         if (tx->first_nf == tx->last_nf - 1) {
                 RTE_LOG(INFO,
@@ -234,6 +337,7 @@ tx_thread_main(void *arg) {
         }
 
         for (; worker_keep_running;) {
+                t0 = rte_rdtsc();
                 /* Read packets from the NF's tx queue and process them as needed */
                 for (i = tx->first_nf; i < tx->last_nf; i++) {
                         nf = &nfs[i];
@@ -246,14 +350,19 @@ tx_thread_main(void *arg) {
                         /* Now process the Client packets read */
                         if (likely(tx_count > 0)) {
                                 onvm_pkt_process_tx_batch(tx, pkts, tx_count, nf);
+                                cyc->pkts += tx_count;
                         }
                 }
+                t1 = rte_rdtsc();
 
                 /* Send a burst to every port */
                 onvm_pkt_flush_all_ports(tx);
 
                 /* Send a burst to every NF */
                 onvm_pkt_flush_all_nfs(tx);
+                t2 = rte_rdtsc();
+                cyc->cycles[FP_CYC_TX_BATCH] += t1 - t0;
+                cyc->cycles[FP_CYC_TX_FLUSH] += t2 - t1;
         }
 
         RTE_LOG(INFO, APP, "Core %d: TX thread done\n", rte_lcore_id());
@@ -274,7 +383,7 @@ handle_signal(int sig) {
 
 int
 main(int argc, char *argv[]) {
-        unsigned cur_lcore, rx_lcores, tx_lcores;
+        unsigned cur_lcore, rx_lcores, tx_lcores, ctrl_lcores, sa_lcores, action_lcores;
         unsigned nfs_per_tx;
         unsigned i;
 
@@ -289,11 +398,26 @@ main(int argc, char *argv[]) {
         /* clear statistics */
         onvm_stats_clear_all_nfs();
 
-        /* Reserve n cores for: 1 Stats, 1 final Tx out, and ONVM_NUM_RX_THREADS for Rx */
+        /* Rings from the RX threads to the pipeline's action cores */
+        if (onvm_pkt_pipeline_init(num_rx_threads, num_action_lcores) != 0) {
+                RTE_LOG(ERR, APP, "Cannot create pipeline action rings\n");
+                return -1;
+        }
+
+        /* Reserve n cores for: 1 Stats, 1 final Tx out, num_rx_threads for Rx, with -c, 1 for LMAT consolidation,
+         * num_sa_workers for state actions and num_action_lcores for the pipeline's action stage */
         cur_lcore = rte_lcore_id();
 		printf("rte_lcore_id():%d\n",rte_lcore_id());
-        rx_lcores = ONVM_NUM_RX_THREADS;
-        tx_lcores = rte_lcore_count() - rx_lcores - 1;
+        rx_lcores = num_rx_threads;
+        ctrl_lcores = fp_ctrl_lcore ? 1 : 0;
+        sa_lcores = num_sa_workers;
+        action_lcores = num_action_lcores;
+        if (rte_lcore_count() < rx_lcores + ctrl_lcores + sa_lcores + action_lcores + 2) {
+                RTE_LOG(ERR, APP, "Need at least %u cores for %u RX threads, %u state action workers and %u action cores\n",
+                        rx_lcores + ctrl_lcores + sa_lcores + action_lcores + 2, rx_lcores, sa_lcores, action_lcores);
+                return -1;
+        }
+        tx_lcores = rte_lcore_count() - rx_lcores - ctrl_lcores - sa_lcores - action_lcores - 1;
 		//printf("rte_lcore_count:%d\n",rte_lcore_count());
         /* Offset cur_lcore to start assigning TX cores */
         cur_lcore += (rx_lcores-1);
@@ -301,6 +425,9 @@ main(int argc, char *argv[]) {
         RTE_LOG(INFO, APP, "%d cores available in total\n", rte_lcore_count());
         RTE_LOG(INFO, APP, "%d cores available for handling manager RX queues\n", rx_lcores);
         RTE_LOG(INFO, APP, "%d cores available for handling TX queues\n", tx_lcores);
+        RTE_LOG(INFO, APP, "%d cores available for handling LMAT consolidation\n", ctrl_lcores);
+        RTE_LOG(INFO, APP, "%d cores available for handling state actions\n", sa_lcores);
+        RTE_LOG(INFO, APP, "%d cores available for handling fast path actions\n", action_lcores);
         RTE_LOG(INFO, APP, "%d cores available for handling stats\n", 1);
 
         /* Evenly assign NFs to TX threads */
@@ -324,6 +451,7 @@ main(int argc, char *argv[]) {
         for (i = 0; i < tx_lcores; i++) {
                 struct thread_info *tx = calloc(1, sizeof(struct thread_info));
                 tx->queue_id = i;
+                tx->port_queue_id = i;
                 tx->port_tx_buf = calloc(RTE_MAX_ETHPORTS, sizeof(struct packet_buf));
                 tx->nf_rx_buf = calloc(MAX_NFS, sizeof(struct packet_buf));
                 tx->first_nf = RTE_MIN(i * nfs_per_tx + 1, (unsigned)MAX_NFS);
@@ -346,8 +474,20 @@ main(int argc, char *argv[]) {
         for (i = 0; i < rx_lcores; i++) {
                 struct thread_info *rx = calloc(1, sizeof(struct thread_info));
                 rx->queue_id = i;
-                rx->port_tx_buf = NULL;
+                /* With -x fast path packets skip the TX ring and core */
+                rx->port_tx_buf = fp_direct_tx ? calloc(RTE_MAX_ETHPORTS, sizeof(struct packet_buf)) : NULL;
+                rx->port_queue_id = ONVM_DIRECT_TXQ(i);
                 rx->nf_rx_buf = calloc(MAX_NFS, sizeof(struct packet_buf));
+                rx->park = park_pool_create();
+                if (rx->park == NULL) {
+                        RTE_LOG(ERR, APP, "Cannot allocate parking buffer for RX queue id %d\n", i);
+                        return -1;
+                }
+                rx->wheel = flow_wheel_create(i);
+                if (rx->wheel == NULL) {
+                        RTE_LOG(ERR, APP, "Cannot allocate flow timer wheel for RX queue id %d\n", i);
+                        return -1;
+                }
                 cur_lcore = rte_get_next_lcore(cur_lcore, 1, 1);
                 if (rte_eal_remote_launch(rx_thread_main, (void *)rx, cur_lcore) == -EBUSY) {
                         RTE_LOG(ERR,
@@ -359,6 +499,50 @@ main(int argc, char *argv[]) {
                 }
         }
 
+        /* Launch the control thread if consolidation is moved off the RX cores */
+        if (ctrl_lcores) {
+                cur_lcore = rte_get_next_lcore(cur_lcore, 1, 1);
+                if (rte_eal_remote_launch(ctrl_thread_main, NULL, cur_lcore) == -EBUSY) {
+                        RTE_LOG(ERR,
+                                APP,
+                                "Core %d is already busy, can't use for the control thread\n",
+                                cur_lcore);
+                        return -1;
+                }
+        }
+
+        /* Launch the state action workers */
+        for (i = 0; i < sa_lcores; i++) {
+                cur_lcore = rte_get_next_lcore(cur_lcore, 1, 1);
+                if (rte_eal_remote_launch(sa_worker_main, (void *)(uintptr_t)i, cur_lcore) == -EBUSY) {
+                        RTE_LOG(ERR,
+                                APP,
+                                "Core %d is already busy, can't use for state action worker %d\n",
+                                cur_lcore,
+                                i);
+                        return -1;
+                }
+        }
+
+        /* Launch the action cores of the pipeline, their stats slots follow the RX threads' */
+        for (i = 0; i < action_lcores; i++) {
+                struct thread_info *act = calloc(1, sizeof(struct thread_info));
+                act->queue_id = rx_lcores + i;
+                act->port_tx_buf = fp_direct_tx ? calloc(RTE_MAX_ETHPORTS, sizeof(struct packet_buf)) : NULL;
+                act->port_queue_id = ONVM_DIRECT_TXQ(rx_lcores + i);
+                /* Packets of flows an update rule sends back to the NFs */
+                act->nf_rx_buf = calloc(MAX_NFS, sizeof(struct packet_buf));
+                cur_lcore = rte_get_next_lcore(cur_lcore, 1, 1);
+                if (rte_eal_remote_launch(action_thread_main, (void *)act, cur_lcore) == -EBUSY) {
+                        RTE_LOG(ERR,
+                                APP,
+                                "Core %d is already busy, can't use for action thread %d\n",
+                                cur_lcore,
+                                i);
+                        return -1;
+                }
+        }
+
         /* Master thread handles statistics and NF management */
         master_thread_main();
         return 0;
@@ -71,6 +71,35 @@ ONVM_STATS_OUTPUT stats_destination = ONVM_STATS_NONE;
 /* global var for how long stats should wait before updating - extern in init.h */
 uint16_t global_stats_sleep_time = 1;
 
+/* global var for whether LMAT consolidation runs on its own lcore - extern in init.h */
+uint8_t fp_ctrl_lcore = 0;
+
+/* global var for the number of RX queues/lcores - extern in init.h */
+uint8_t num_rx_threads = 1;
+
+/* global var for the number of state action worker lcores - extern in init.h */
+uint8_t num_sa_workers = 0;
+
+/* global var for the GMAT snapshot file, NULL without warm restart - extern in init.h */
+const char *fp_snapshot_path = NULL;
+
+/* global var for the seconds between GMAT checkpoints - extern in init.h */
+uint16_t fp_snapshot_interval = 60;
+
+/* global var for the number of pipeline action lcores, 0 runs to completion - extern in init.h */
+uint8_t num_action_lcores = 0;
+
+/* global var for whether RX threads transmit fast path packets themselves - extern in init.h */
+uint8_t fp_direct_tx = 0;
+
+/* global var for whether idle RX threads run flow groups of backlogged ones - extern in init.h */
+uint8_t fp_steal = 0;
+
+/* global vars for the idle timeout of cached flows, in seconds - extern in init.h */
+uint16_t fp_tcp_timeout = 300;
+uint16_t fp_udp_timeout = 30;
+uint16_t fp_other_timeout = 30;
+
 /* global var for program name */
 static const char *progname;
 
@@ -99,6 +128,18 @@ parse_stats_output(const char *stats_output);
 static int
 parse_stats_sleep_time(const char *sleeptime);
 
+static int
+parse_num_rx_threads(const char *rx_threads);
+
+static int
+parse_flow_timeout(const char *timeout, uint16_t *dst);
+
+static int
+parse_num_sa_workers(const char *sa_workers);
+
+static int
+parse_num_action_lcores(const char *action_lcores);
+
 
 /*********************************Interfaces**********************************/
 
@@ -113,12 +154,23 @@ parse_app_args(uint8_t max_ports, int argc, char *argv[]) {
                 {"num-services",        required_argument,      NULL,   'r'},
                 {"default-service",     required_argument,      NULL,   'd'},
                 {"stats-out",           no_argument,            NULL,   's'},
-                {"stats-sleep-time",    no_argument,            NULL,   'z'}
+                {"stats-sleep-time",    no_argument,            NULL,   'z'},
+                {"ctrl-core",           no_argument,            NULL,   'c'},
+                {"rx-threads",          required_argument,      NULL,   'q'},
+                {"tcp-timeout",         required_argument,      NULL,   't'},
+                {"udp-timeout",         required_argument,      NULL,   'u'},
+                {"other-timeout",       required_argument,      NULL,   'o'},
+                {"sa-workers",          required_argument,      NULL,   'w'},
+                {"snapshot",            required_argument,      NULL,   'S'},
+                {"snapshot-interval",   required_argument,      NULL,   'k'},
+                {"direct-tx",           no_argument,            NULL,   'x'},
+                {"action-cores",        required_argument,      NULL,   'a'},
+                {"steal",               no_argument,            NULL,   'b'}
         };
 
         progname = argv[0];
 
-        while ((opt = getopt_long(argc, argvopt, "p:r:d:s:z:", lgopts, &option_index)) != EOF) {
+        while ((opt = getopt_long(argc, argvopt, "p:r:d:s:z:cq:t:u:o:w:S:k:xa:b", lgopts, &option_index)) != EOF) {
                 switch (opt) {
                         case 'p':
                                 if (parse_portmask(max_ports, optarg) != 0) {
@@ -152,6 +204,60 @@ parse_app_args(uint8_t max_ports, int argc, char *argv[]) {
                                         return -1;
                                 }
                                 break;
+                        case 'c':
+                                fp_ctrl_lcore = 1;
+                                break;
+                        case 'q':
+                                if (parse_num_rx_threads(optarg) != 0) {
+                                        usage();
+                                        return -1;
+                                }
+                                break;
+                        case 't':
+                                if (parse_flow_timeout(optarg, &fp_tcp_timeout) != 0) {
+                                        usage();
+                                        return -1;
+                                }
+                                break;
+                        case 'u':
+                                if (parse_flow_timeout(optarg, &fp_udp_timeout) != 0) {
+                                        usage();
+                                        return -1;
+                                }
+                                break;
+                        case 'o':
+                                if (parse_flow_timeout(optarg, &fp_other_timeout) != 0) {
+                                        usage();
+                                        return -1;
+                                }
+                                break;
+                        case 'w':
+                                if (parse_num_sa_workers(optarg) != 0) {
+                                        usage();
+                                        return -1;
+                                }
+                                break;
+                        case 'S':
+                                fp_snapshot_path = optarg;
+                                break;
+                        case 'k':
+                                if (parse_flow_timeout(optarg, &fp_snapshot_interval) != 0) {
+                                        usage();
+                                        return -1;
+                                }
+                                break;
+                        case 'x':
+                                fp_direct_tx = 1;
+                                break;
+                        case 'a':
+                                if (parse_num_action_lcores(optarg) != 0) {
+                                        usage();
+                                        return -1;
+                                }
+                                break;
+                        case 'b':
+                                fp_steal = 1;
+                                break;
                         default:
                                 printf("ERROR: Unknown option '%c'\n", opt);
                                 usage();
@@ -159,6 +265,20 @@ parse_app_args(uint8_t max_ports, int argc, char *argv[]) {
                 }
         }
 
+        /* Action cores run the state actions of their flows themselves */
+        if (num_action_lcores && num_sa_workers) {
+                printf("ERROR: -a and -w cannot be combined\n");
+                usage();
+                return -1;
+        }
+
+        /* A stolen flow group must reach the TX ring before the owner's next packets of the flow */
+        if (fp_steal && (num_action_lcores || num_sa_workers || fp_direct_tx)) {
+                printf("ERROR: -b cannot be combined with -a, -w or -x\n");
+                usage();
+                return -1;
+        }
+
         return 0;
 }
 
@@ -169,13 +289,24 @@ parse_app_args(uint8_t max_ports, int argc, char *argv[]) {
 static void
 usage(void) {
         printf(
-            "%s [EAL options] -- -p PORTMASK [-r NUM_SERVICES] [-d DEFAULT_SERVICE] [-s STATS_OUTPUT]\n"
+            "%s [EAL options] -- -p PORTMASK [-r NUM_SERVICES] [-d DEFAULT_SERVICE] [-s STATS_OUTPUT] [-c] [-q RX_THREADS] [-t TCP_TIMEOUT] [-u UDP_TIMEOUT] [-o OTHER_TIMEOUT] [-w SA_WORKERS] [-S SNAPSHOT_FILE] [-k SNAPSHOT_INTERVAL] [-x] [-a ACTION_CORES] [-b]\n"
             "\t-p PORTMASK: hexadecimal bitmask of ports to use\n"
             "\t-r NUM_SERVICES: number of unique serivces allowed. defaults to 16 (optional)\n"
             "\t-d DEFAULT_SERVICE: the service to initially receive packets. defaults to 1 (optional)\n"
             "\t-s STATS_OUTPUT: where to output manager stats (stdout/stderr/web). defaults to NONE (optional)\n"
-            "\t-z STATS_SLEEP_TIME: how long the stats thread should wait before updating the stats (in seconds)\n",
-            progname);
+            "\t-z STATS_SLEEP_TIME: how long the stats thread should wait before updating the stats (in seconds)\n"
+            "\t-c: run LMAT consolidation and GMAT installation on a dedicated control core (optional)\n"
+            "\t-q RX_THREADS: number of RX queues/cores, flows are spread over them by RSS. defaults to 1, max %d (optional)\n"
+            "\t-t TCP_TIMEOUT: seconds an idle TCP flow stays cached. defaults to 300, FIN/RST evicts at once (optional)\n"
+            "\t-u UDP_TIMEOUT: seconds an idle UDP flow stays cached. defaults to 30 (optional)\n"
+            "\t-o OTHER_TIMEOUT: seconds an idle flow of any other protocol stays cached. defaults to 30 (optional)\n"
+            "\t-w SA_WORKERS: cores running the state actions of fast path packets off the RX cores. defaults to 0, max %d (optional)\n"
+            "\t-S SNAPSHOT_FILE: checkpoint the fast path flows to this file and restore them from it on start (optional)\n"
+            "\t-k SNAPSHOT_INTERVAL: seconds between checkpoints with -S. defaults to 60 (optional)\n"
+            "\t-x: RX cores send fast path packets to their output port on their own NIC TX queue, not through a TX core (optional)\n"
+            "\t-a ACTION_CORES: pipeline the fast path, RX cores classify and these cores run the actions and TX. defaults to 0 (run to completion), max %d, not with -w (optional)\n"
+            "\t-b: idle RX cores run whole fast path flow groups of backlogged RX cores, not with -a, -w or -x (optional)\n",
+            progname, ONVM_MAX_RX_THREADS, ONVM_MAX_SA_WORKERS, ONVM_MAX_ACTION_LCORES);
 }
 
 
@@ -270,3 +401,56 @@ parse_stats_output(const char *stats_output) {
                 return -1;
         }
 }
+
+static int
+parse_num_rx_threads(const char *rx_threads) {
+        char *end = NULL;
+        unsigned long temp;
+
+        temp = strtoul(rx_threads, &end, 10);
+        if (end == NULL || *end != '\0' || temp == 0 || temp > ONVM_MAX_RX_THREADS)
+                return -1;
+
+        num_rx_threads = (uint8_t)temp;
+        return 0;
+}
+
+static int
+parse_flow_timeout(const char *timeout, uint16_t *dst) {
+        char *end = NULL;
+        unsigned long temp;
+
+        temp = strtoul(timeout, &end, 10);
+        if (end == NULL || *end != '\0' || temp == 0 || temp > UINT16_MAX)
+                return -1;
+
+        *dst = (uint16_t)temp;
+        return 0;
+}
+
+static int
+parse_num_sa_workers(const char *sa_workers) {
+        char *end = NULL;
+        unsigned long temp;
+
+        temp = strtoul(sa_workers, &end, 10);
+        if (end == NULL || *end != '\0' || temp > ONVM_MAX_SA_WORKERS)
+                return -1;
+
+        num_sa_workers = (uint8_t)temp;
+        return 0;
+}
+
+
+static int
+parse_num_action_lcores(const char *action_lcores) {
+        char *end = NULL;
+        unsigned long temp;
+
+        temp = strtoul(action_lcores, &end, 10);
+        if (end == NULL || *end != '\0' || temp > ONVM_MAX_ACTION_LCORES)
+                return -1;
+
+        num_action_lcores = (uint8_t)temp;
+        return 0;
+}
@@ -50,6 +50,7 @@
 
 
 #include "onvm_mgr/onvm_init.h"
+#include "onvm_mgr/fastpath_pkt.h"
 
 
 /********************************Global variables*****************************/
@@ -163,6 +164,7 @@ init(int argc, char *argv[]) {
         const struct rte_memzone *mz_nf;
         const struct rte_memzone *mz_port;
         const struct rte_memzone *mz_scp;
+        const struct rte_memzone *mz_tunnel;
         uint8_t i, total_ports, port_id;
 
         /* init EAL, parsing EAL args */
@@ -225,7 +227,8 @@ init(int argc, char *argv[]) {
                 rte_exit(EXIT_FAILURE, "Cannot create nf message pool: %s\n", rte_strerror(rte_errno));
         }
 
-        /* now initialise the ports we will use */
+        /* now initialise the ports we will use, init_port clears this for a port that cannot */
+        fp_csum_offload = 1;
         for (i = 0; i < ports->num_ports; i++) {
                 port_id = ports->id[i];
                 rte_eth_macaddr_get(port_id, &ports->mac[port_id]);
@@ -263,8 +266,33 @@ init(int argc, char *argv[]) {
         *default_sc_p = default_chain;
         onvm_sc_print(default_chain);
 
+        /* set up the tunnel templates NFs register for ACTION_ENCAP/ACTION_DECAP */
+        mz_tunnel = rte_memzone_reserve(MZ_TUNNEL_INFO, sizeof(*fp_tunnels),
+                                        rte_socket_id(), NO_FLAGS);
+        if (mz_tunnel == NULL)
+                rte_exit(EXIT_FAILURE, "Cannot reserve memory zone for tunnel templates\n");
+        memset(mz_tunnel->addr, 0, sizeof(*fp_tunnels));
+        fp_tunnels = mz_tunnel->addr;
+
         onvm_flow_dir_init();
 
+        /* initialise the 5-tuple keyed GMAT flow cache */
+        if (GMAT_init(num_rx_threads) != 0)
+                rte_exit(EXIT_FAILURE, "Cannot create GMAT flow cache\n");
+
+        /* warm restart: put the flows of the last checkpoint back on the fast path */
+        if (fp_snapshot_path != NULL) {
+                retval = GMAT_snapshot_restore(fp_snapshot_path);
+                if (retval < 0)
+                        RTE_LOG(INFO, APP, "No usable GMAT snapshot in %s, starting cold\n", fp_snapshot_path);
+                else
+                        RTE_LOG(INFO, APP, "Restored %d flows from GMAT snapshot %s\n", retval, fp_snapshot_path);
+        }
+
+        /* rings from the RX threads to the state action workers */
+        if (SA_workers_init(num_rx_threads, num_sa_workers) != 0)
+                rte_exit(EXIT_FAILURE, "Cannot create state action worker rings\n");
+
         return 0;
 }
 
@@ -280,6 +308,11 @@ static int
 init_mbuf_pools(void) {
         const unsigned num_mbufs = (MAX_NFS * MBUFS_PER_NF) \
                         + (ports->num_ports * MBUFS_PER_PORT);
+        /* Reserve the private area holding struct onvm_fp_meta */
+        struct rte_pktmbuf_pool_private mbp_priv = {
+                .mbuf_data_room_size = RTE_PKTMBUF_HEADROOM + RX_MBUF_DATA_SIZE,
+                .mbuf_priv_size = ONVM_FP_META_SIZE,
+        };
 
         /* don't pass single-producer/single-consumer flags to mbuf create as it
          * seems faster to use a cache instead */
@@ -288,7 +321,7 @@ init_mbuf_pools(void) {
         pktmbuf_pool = rte_mempool_create(PKTMBUF_POOL_NAME, num_mbufs,
                         MBUF_SIZE, MBUF_CACHE_SIZE,
                         sizeof(struct rte_pktmbuf_pool_private), rte_pktmbuf_pool_init,
-                        NULL, rte_pktmbuf_init, NULL, rte_socket_id(), NO_FLAGS);
+                        &mbp_priv, rte_pktmbuf_init, NULL, rte_socket_id(), NO_FLAGS);
 
         return (pktmbuf_pool == NULL); /* 0  on success */
 }
@@ -354,10 +387,12 @@ init_nf_LMAT_pool(void)
  */
 static int
 init_port(uint8_t port_num) {
-        const uint16_t rx_rings = ONVM_NUM_RX_THREADS, tx_rings = MAX_NFS;
+        const uint16_t rx_rings = num_rx_threads;
+        const uint16_t tx_rings = fp_direct_tx ? ONVM_DIRECT_TXQ(num_rx_threads + num_action_lcores) : MAX_NFS;
         const uint16_t rx_ring_size = RTE_MP_RX_DESC_DEFAULT;
         const uint16_t tx_ring_size = RTE_MP_TX_DESC_DEFAULT;
 
+        struct rte_eth_dev_info dev_info;
         uint16_t q;
         int retval;
 
@@ -386,6 +421,13 @@ init_port(uint8_t port_num) {
                 if (retval < 0) return retval;
         }
 
+        /* Fast path rewrites leave the IPv4 header checksum to the NIC if every port computes it */
+        rte_eth_dev_info_get(port_num, &dev_info);
+        if (!(dev_info.tx_offload_capa & DEV_TX_OFFLOAD_IPV4_CKSUM))
+                fp_csum_offload = 0;
+        printf("Port %u IPv4 checksum offload %s ... \n", (unsigned)port_num,
+               (dev_info.tx_offload_capa & DEV_TX_OFFLOAD_IPV4_CKSUM) ? "on" : "off");
+
         rte_eth_promiscuous_enable(port_num);
 
         retval  = rte_eth_dev_start(port_num);
@@ -408,6 +450,7 @@ init_shm_rings(void) {
         const char * rq_name;
         const char * tq_name;
         const char * msg_q_name;
+        const char * teardown_q_name;
         const unsigned ringsize = NF_QUEUE_RINGSIZE;
         const unsigned msgringsize = NF_MSG_QUEUE_SIZE;
 
@@ -432,6 +475,7 @@ init_shm_rings(void) {
 				//printf("rq_name:%s\n",rq_name);
                 tq_name = get_tx_queue_name(i);
                 msg_q_name = get_msg_queue_name(i);
+                teardown_q_name = get_teardown_queue_name(i);
                 nfs[i].instance_id = i;
                 nfs[i].rx_q = rte_ring_create(rq_name,
                                 ringsize, socket_id,
@@ -442,6 +486,9 @@ init_shm_rings(void) {
                 nfs[i].msg_q = rte_ring_create(msg_q_name,
                                 msgringsize, socket_id,
                                 RING_F_SC_DEQ);                 /* multi prod, single cons */
+                nfs[i].teardown_q = rte_ring_create(teardown_q_name,
+                                NF_TEARDOWN_QUEUE_SIZE, socket_id,
+                                RING_F_SP_ENQ | RING_F_SC_DEQ); /* LMAT consolidation -> NF */
 
                 if (nfs[i].rx_q == NULL)
                         rte_exit(EXIT_FAILURE, "Cannot create rx ring queue for NF %u\n", i);
@@ -451,6 +498,9 @@ init_shm_rings(void) {
 
                 if (nfs[i].msg_q == NULL)
                         rte_exit(EXIT_FAILURE, "Cannot create msg queue for NF %u\n", i);
+
+                if (nfs[i].teardown_q == NULL)
+                        rte_exit(EXIT_FAILURE, "Cannot create teardown queue for NF %u\n", i);
         }
         return 0;
 }
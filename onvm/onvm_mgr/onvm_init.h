@@ -86,7 +86,7 @@
 #define MBUFS_PER_NF 1536
 #define MBUFS_PER_PORT 1536
 #define MBUF_CACHE_SIZE 512
-#define MBUF_OVERHEAD (sizeof(struct rte_mbuf) + RTE_PKTMBUF_HEADROOM)
+#define MBUF_OVERHEAD (sizeof(struct rte_mbuf) + ONVM_FP_META_SIZE + RTE_PKTMBUF_HEADROOM)
 #define RX_MBUF_DATA_SIZE 2048
 #define MBUF_SIZE (RX_MBUF_DATA_SIZE + MBUF_OVERHEAD)
 
@@ -103,10 +103,16 @@
 #define RTE_MP_TX_DESC_DEFAULT 512
 #define NF_QUEUE_RINGSIZE 16384
 #define NF_MSG_QUEUE_SIZE 128
+#define NF_TEARDOWN_QUEUE_SIZE 4096
 
 #define NO_FLAGS 0
 
-#define ONVM_NUM_RX_THREADS 1
+#define ONVM_MAX_RX_THREADS 8
+#define ONVM_MAX_SA_WORKERS 8
+#define ONVM_MAX_ACTION_LCORES 8
+/* NIC TX queue of RX thread rx with -x, after the TX threads' MAX_NFS. Action
+ * core a of the pipeline uses ONVM_DIRECT_TXQ(num_rx_threads + a). */
+#define ONVM_DIRECT_TXQ(rx) (MAX_NFS + (rx))
 
 
 /*************************External global variables***************************/
@@ -136,6 +142,17 @@ extern struct onvm_service_chain *fp_chain;
 extern struct onvm_ft *sdn_ft;
 extern ONVM_STATS_OUTPUT stats_destination;
 extern uint16_t global_stats_sleep_time;
+extern uint8_t fp_ctrl_lcore;
+extern uint8_t num_rx_threads;
+extern uint8_t num_sa_workers;
+extern const char *fp_snapshot_path;
+extern uint16_t fp_snapshot_interval;
+extern uint8_t fp_direct_tx;
+extern uint8_t num_action_lcores;
+extern uint8_t fp_steal;
+extern uint16_t fp_tcp_timeout;
+extern uint16_t fp_udp_timeout;
+extern uint16_t fp_other_timeout;
 
 /**********************************Functions**********************************/
 
@@ -128,6 +128,12 @@ struct thread_info {
         */
        struct packet_buf *nf_rx_buf;
        struct packet_buf *port_tx_buf;
+       /* NIC TX queue port_tx_buf is flushed to, on every port */
+       unsigned port_queue_id;
+       /* Packets of pending flows, only set for RX threads */
+       struct park_pool *park;
+       /* Idle timers of the flows in this RX thread's GMAT shard */
+       struct flow_wheel *wheel;
 };
 
 
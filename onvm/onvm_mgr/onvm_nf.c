@@ -58,11 +58,9 @@ uint16_t next_instance_id = 0;
 
 //extern int LMAT_bef_cons[(NUM_OF_NF)+1][5];
 
-extern int OP_LMAT_bef_cons[NUM_OF_FLOW][1 + 3 * NUM_OF_NF];
-extern int FP_LMAT_bef_cons[NUM_OF_FLOW][1 + 3 * NUM_OF_NF];
-extern uint64_t cyc_start, cyc_end;
-extern uint64_t cyc_start_1, cyc_end_1;
-extern uint64_t cyc_start_2, cyc_end_2;
+extern uint32_t OP_LMAT_bef_cons[NUM_OF_FLOW];
+extern uint32_t FP_LMAT_bef_cons[NUM_OF_FLOW];
+extern uint32_t OP_LMAT_gen[NUM_OF_FLOW];
 /************************Internal functions prototypes************************/
 
 
@@ -99,6 +97,25 @@ inline static int
 onvm_nf_stop(struct onvm_nf_info *nf_info);
 
 
+/*
+ * Function installing a flow whose LMAT reports cover the live chain.
+ *
+ * Input  : the flow's FID and the generation its reports were made for
+ *
+ */
+static void
+onvm_nf_consolidate(uint32_t FID, uint32_t gen);
+
+
+/*
+ * Function installing the pending flows of every GMAT shard whose LMAT
+ * reports cover the live chain, after an NF left it.
+ *
+ */
+static void
+onvm_nf_consolidate_pending(void);
+
+
 /********************************Interfaces***********************************/
 
 
@@ -167,6 +184,7 @@ onvm_nf_check_status(void) {
 void
 onvm_nf_check_LMAT(void) {
         int i;
+        uint32_t FID, bit;
         void *LMAT_msg[MAX_NFS*128];
 		struct onvm_nf_LMAT *onvm_mgr_LMAT;
         int num_msgs = rte_ring_count(incoming_lmat_queue);
@@ -176,26 +194,61 @@ onvm_nf_check_LMAT(void) {
 		
         if (num_msgs == 0) return;
 		
-		cyc_end = rte_get_timer_cycles();
         for (i = 0; i < num_msgs; i++) {
 			onvm_mgr_LMAT = (struct onvm_nf_LMAT*) LMAT_msg[i];
+			if(onvm_mgr_LMAT->state_func_flag == IS_LEAVE)
+			{
+				onvm_nf_consolidate_pending();
+				rte_mempool_put(nf_LMAT_pool, (void*)onvm_mgr_LMAT);
+				continue;
+			}
+			if((uint32_t)onvm_mgr_LMAT->hash >= ((uint32_t)num_rx_threads << GMAT_shard_bits))
+			{
+				//FID_NULL: the flow has no GMAT entry, nothing to consolidate
+				rte_mempool_put(nf_LMAT_pool, (void*)onvm_mgr_LMAT);
+				continue;
+			}
+			if(onvm_mgr_LMAT->state_func_flag == IS_EVICT)
+			{
+				/* Queued by the RX core before the FID could be reused */
+				GMAT_flow_cleanup(onvm_mgr_LMAT->hash);
+				onvm_nf_send_teardown(onvm_mgr_LMAT->hash);
+				rte_mempool_put(nf_LMAT_pool, (void*)onvm_mgr_LMAT);
+				continue;
+			}
+			/* Reports of NFs outside the chain are not consolidated */
+			bit = (onvm_mgr_LMAT->nf_id < 1 || onvm_mgr_LMAT->nf_id >= MAX_NFS)
+					? 0 : lmat_chain.pos[onvm_mgr_LMAT->nf_id];
+			if(bit == 0)
+			{
+				rte_mempool_put(nf_LMAT_pool, (void*)onvm_mgr_LMAT);
+				continue;
+			}
+			rte_smp_rmb();
+			FID = onvm_mgr_LMAT->hash;
+			/* The flow was evicted after the NF saw the packet, the FID may
+			 * already hold another one */
+			if(onvm_mgr_LMAT->gen != GMAT_entry(FID)->gen)
+			{
+				rte_mempool_put(nf_LMAT_pool, (void*)onvm_mgr_LMAT);
+				continue;
+			}
+			bit--;
 			if(onvm_mgr_LMAT->state_func_flag == IS_OP)
 			{
-				if(OP_LMAT_bef_cons[onvm_mgr_LMAT->hash][(onvm_mgr_LMAT->nf_id - 1)*3 + 1] == 0)
-				{
-					OP_LMAT_bef_cons[onvm_mgr_LMAT->hash][0]++;
-				}	
-				OP_LMAT_bef_cons[onvm_mgr_LMAT->hash][(onvm_mgr_LMAT->nf_id - 1)*3 + 1] = onvm_mgr_LMAT->packet_action;
-				OP_LMAT_bef_cons[onvm_mgr_LMAT->hash][(onvm_mgr_LMAT->nf_id - 1)*3 + 2] = onvm_mgr_LMAT->field;
-				OP_LMAT_bef_cons[onvm_mgr_LMAT->hash][(onvm_mgr_LMAT->nf_id - 1)*3 + 3] = onvm_mgr_LMAT->value;
+				LMAT_add_rule(LMAT[bit], FID, onvm_mgr_LMAT->packet_action,
+						onvm_mgr_LMAT->field, onvm_mgr_LMAT->value, onvm_mgr_LMAT->port, lmat_chain.sa[bit]);
+				if(lmat_chain.sa_pkt[bit] != NULL)
+					LMAT_add_rule_snort(LMAT[bit], FID, onvm_mgr_LMAT->packet_action,
+							onvm_mgr_LMAT->field, onvm_mgr_LMAT->value, onvm_mgr_LMAT->port, lmat_chain.sa_pkt[bit]);
+				OP_LMAT_bef_cons[FID] |= 1U << bit;
+				OP_LMAT_gen[FID] = onvm_mgr_LMAT->gen;
+				/* Pending flow is complete: every running NF of the chain has reported */
+				if((OP_LMAT_bef_cons[FID] & lmat_chain.live) == lmat_chain.live
+						&& GMAT_entry(FID)->flag == 0)
+					onvm_nf_consolidate(FID, onvm_mgr_LMAT->gen);
 			}else{
-				if(FP_LMAT_bef_cons[onvm_mgr_LMAT->hash][(onvm_mgr_LMAT->nf_id - 1)*3 + 1] == 0)
-				{
-					FP_LMAT_bef_cons[onvm_mgr_LMAT->hash][0]++;
-				}
-				FP_LMAT_bef_cons[onvm_mgr_LMAT->hash][(onvm_mgr_LMAT->nf_id - 1)*3 + 1] = onvm_mgr_LMAT->packet_action;
-				FP_LMAT_bef_cons[onvm_mgr_LMAT->hash][(onvm_mgr_LMAT->nf_id - 1)*3 + 2] = onvm_mgr_LMAT->field;
-				FP_LMAT_bef_cons[onvm_mgr_LMAT->hash][(onvm_mgr_LMAT->nf_id - 1)*3 + 3] = onvm_mgr_LMAT->value;
+				FP_LMAT_bef_cons[FID] |= 1U << bit;
 			}
 			rte_mempool_put(nf_LMAT_pool, (void*)onvm_mgr_LMAT);
         }
@@ -221,6 +274,19 @@ onvm_nf_send_msg(uint16_t dest, uint8_t msg_type, void *msg_data) {
 }
 
 
+void
+onvm_nf_send_teardown(uint32_t FID) {
+        uint16_t i;
+
+        for (i = 1; i < MAX_NFS; i++) {
+                if (!onvm_nf_is_valid(&nfs[i]))
+                        continue;
+                /* A full ring means the NF is not draining it, it misses the notice */
+                rte_ring_sp_enqueue(nfs[i].teardown_q, (void *)(uintptr_t)FID);
+        }
+}
+
+
 inline uint16_t
 onvm_nf_service_to_nf_map(uint16_t service_id, struct rte_mbuf *pkt) {
         uint16_t num_nfs_available = nf_per_service_count[service_id];
@@ -280,6 +346,9 @@ onvm_nf_start(struct onvm_nf_info *nf_info) {
 
 inline static int
 onvm_nf_ready(struct onvm_nf_info *info) {
+        SA sa = NF1_state_action;
+        SA_SNORT sa_pkt = NULL;
+
         // Ensure we've already called nf_start for this NF
         if (info->status != NF_STARTING) return -1;
 
@@ -288,6 +357,20 @@ onvm_nf_ready(struct onvm_nf_info *info) {
         uint16_t service_count = nf_per_service_count[info->service_id]++;
         services[info->service_id][service_count] = info->instance_id;
         num_nfs++;
+
+        /* Bind the state actions it shipped, the built-in one otherwise */
+        info->sa_module[ONVM_SA_MODULE_LEN - 1] = '\0';
+        if (info->sa_module[0] != '\0' && SA_module_load(info->sa_module, &sa, &sa_pkt) != 0) {
+                RTE_LOG(WARNING, APP, "NF %u state actions will not run on the fast path\n",
+                        (unsigned)info->instance_id);
+                sa = NULL;
+                sa_pkt = NULL;
+        }
+
+        /* Its LMAT reports now count towards every new flow's consolidation */
+        if (lmat_chain_join(info->instance_id, info->service_id, sa, sa_pkt) != 0)
+                RTE_LOG(WARNING, APP, "NF %u left out of the fast path chain\n",
+                        (unsigned)info->instance_id);
         return 0;
 }
 
@@ -305,6 +388,10 @@ onvm_nf_stop(struct onvm_nf_info *nf_info) {
         nf_id = nf_info->instance_id;
         service_id = nf_info->service_id;
 
+        /* Pending flows no longer wait for its LMAT report, the
+         * consolidation side installs those that now have every report */
+        lmat_chain_leave(nf_id);
+
         /* Clean up dangling pointers to info struct */
         nfs[nf_id].info = NULL;
 
@@ -343,3 +430,45 @@ onvm_nf_stop(struct onvm_nf_info *nf_info) {
 
         return 0;
 }
+
+
+static void
+onvm_nf_consolidate(uint32_t FID, uint32_t gen) {
+        FP_Cycle_Stats *cyc = &fp_cycle_stats[rte_lcore_id()];
+        uint64_t t0, t1;
+
+        t0 = rte_rdtsc();
+        GMAT_consolidate(FID, gen);
+        t1 = rte_rdtsc();
+        cyc->cycles[FP_CYC_CONSOLIDATE] += t1 - t0;
+        if (GMAT_ctr(FID)->pkts != 0)
+                cyc->cycles[FP_CYC_LMAT_WAIT] += t1 - GMAT_ctr(FID)->first_tsc;
+        cyc->flows++;
+}
+
+
+static void
+onvm_nf_consolidate_pending(void) {
+        const void *key;
+        void *data;
+        MAT_Map *entry;
+        uint32_t live = lmat_chain.live;
+        uint32_t FID, next;
+        int32_t idx;
+        uint16_t s;
+
+        /* With no NF left there is nothing to consolidate the flows from */
+        if (live == 0)
+                return;
+        for (s = 0; s < num_rx_threads; s++) {
+                for (next = 0; (idx = onvm_ft_iterate(GMAT[s], &key, &data, &next)) >= 0;) {
+                        FID = ((uint32_t)s << GMAT_shard_bits) | (uint32_t)idx;
+                        entry = (MAT_Map *)data;
+                        /* The bits may still be those of a flow evicted before its
+                         * notice came in, add_rule_to_GMAT installs nothing then */
+                        if (entry->flag == 0 && OP_LMAT_bef_cons[FID] != 0
+                                        && (OP_LMAT_bef_cons[FID] & live) == live)
+                                onvm_nf_consolidate(FID, OP_LMAT_gen[FID]);
+                }
+        }
+}
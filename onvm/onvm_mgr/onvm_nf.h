@@ -104,6 +104,16 @@ int
 onvm_nf_send_msg(uint16_t dest, uint8_t msg_type, void *msg_data);
 
 
+/*
+ * Interface to tell every running NF that a flow was evicted, so they can
+ * free their own state for it. Only the LMAT consolidation side calls it.
+ *
+ * Input  : the FID of the evicted flow
+ */
+void
+onvm_nf_send_teardown(uint32_t FID);
+
+
 /*
  * Interface giving a NF for a specific server id, depending on the flow.
  *
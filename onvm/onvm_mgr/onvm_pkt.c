@@ -71,18 +71,45 @@
 
 /**********************FastPath Global Variables**************************/
 //extern int LMAT_bef_cons[(NUM_OF_NF) + 1][6];
-extern uint32_t hash_fid;
-extern int cpa[4];
-extern int *tmp_cpa;
 extern int state_val;
-MAT_Map LMAT[NUM_OF_NF][NUM_OF_FLOW], GMAT[NUM_OF_FLOW];
+LMAT_Row *LMAT[FP_MAX_CHAIN];
 URT_Map URT[NUM_OF_FLOW];
-uint32_t op_hash[PACKET_READ_SIZE];
-int OP_LMAT_bef_cons[NUM_OF_FLOW][1 + 3 * NUM_OF_NF];
-int FP_LMAT_bef_cons[NUM_OF_FLOW][1 + 3 * NUM_OF_NF];
-
-uint64_t fp_total_cont;
-uint64_t op_total_cont;
+/* Mask of the chain positions that reported the flow, from the slow/fast path */
+uint32_t OP_LMAT_bef_cons[NUM_OF_FLOW];
+uint32_t FP_LMAT_bef_cons[NUM_OF_FLOW];
+/* FID generation the OP_LMAT_bef_cons bits were reported for */
+uint32_t OP_LMAT_gen[NUM_OF_FLOW];
+
+FP_RX_Stats fp_rx_stats[ONVM_MAX_RX_THREADS + ONVM_MAX_ACTION_LCORES];
+
+/****************************FP Pipeline Variables****************************/
+static struct rte_mempool *fp_desc_pool;
+static struct rte_ring *fp_pipe_ring[ONVM_MAX_RX_THREADS][ONVM_MAX_ACTION_LCORES];
+
+/* Descriptors an RX core staged for each action core, written only by that RX core */
+typedef struct{
+        struct fp_desc *desc[ONVM_MAX_ACTION_LCORES][FP_PIPE_BURST];
+        uint16_t count[ONVM_MAX_ACTION_LCORES];
+} __rte_cache_aligned FP_Pipe_Stage;
+static FP_Pipe_Stage fp_pipe_stage[ONVM_MAX_RX_THREADS];
+
+/****************************FP Work Stealing Variables****************************/
+typedef struct{
+        volatile uint32_t state;
+        uint32_t FID;
+        uint16_t count;
+        int8_t snort_seq;
+        FP_CPA cpa;
+        struct rte_mbuf *pkts[PACKET_READ_SIZE];
+} __rte_cache_aligned FP_Steal_Slot;
+
+/* An RX core's lent flow groups. full and out are only used by the owner */
+typedef struct{
+        FP_Steal_Slot slot[FP_STEAL_SLOTS];
+        uint16_t full;//full bursts in a row
+        uint8_t out;//slots filled and not seen free since
+} __rte_cache_aligned FP_Steal;
+static FP_Steal fp_steal_slots[ONVM_MAX_RX_THREADS];
 
 /****************************FP Snort Variables****************************/
 extern int file_line;      /* current line being processed in the rules file */
@@ -153,6 +180,249 @@ inline static void
 onvm_pkt_process_next_action(struct thread_info *tx, struct rte_mbuf *pkt, struct onvm_nf *nf);
 
 
+/*
+ * Function to send a packet of an installed flow through its GMAT action.
+ * The state actions run for every packet, the packet action is the flow's
+ * consolidated action read once per burst. If the state actions make an
+ * update rule fire, cpa is refreshed before it is applied.
+ *
+ * Inputs : a pointer to the rx queue
+ *          the FID of the packet's flow and its consolidated action
+ *          the snort sequence passed to the state action
+ *          a pointer to the packet
+ *
+ * Output : 1 if the packet is to be dropped, the caller frees it with the
+ *          other drops of the burst, 0 if it goes out, -1 if an update rule
+ *          just sent the flow back to the NFs and the packet is queued for
+ *          them, the caller flushes the NF queues
+ *
+ */
+inline static int
+onvm_pkt_fp_action(struct thread_info *rx, uint32_t FID, FP_CPA *cpa, int snort_seq, struct rte_mbuf *pkt);
+
+
+/*
+ * Function to send fast path packets on. With -x they go into the RX
+ * thread's buffer of their output port and out on its own NIC TX queue,
+ * otherwise onto the TX ring the TX thread drains.
+ *
+ * Inputs : a pointer to the rx queue
+ *          the TX ring of the fast path
+ *          the packets and how many
+ *
+ */
+static void
+onvm_pkt_fp_send(struct thread_info *rx, struct rte_ring *tx_ring, struct rte_mbuf *pkts[], uint16_t count);
+
+
+/*
+ * Function to hand a fast path packet to the action core of its flow, with
+ * a copy of the flow's CPA. Staged descriptors go out FP_PIPE_BURST at a
+ * time or on onvm_pkt_pipe_flush.
+ *
+ * Inputs : a pointer to the rx queue
+ *          the FID of the packet's flow and its CPA
+ *          the snort sequence passed to the state action
+ *          a pointer to the packet
+ *
+ */
+static void
+onvm_pkt_pipe_stage(struct thread_info *rx, uint32_t FID, FP_CPA *cpa, int snort_seq, struct rte_mbuf *pkt);
+
+
+/*
+ * Function to enqueue the descriptors an RX thread staged for one action
+ * core. What the ring has no room for is dropped.
+ *
+ * Inputs : the id of the rx queue
+ *          the index of the action core
+ *
+ */
+static void
+onvm_pkt_pipe_stage_flush(uint16_t rx_id, unsigned act);
+
+
+/*
+ * Function to run the fast path actions of a lent flow group and put its
+ * packets on the TX ring, then free the slot.
+ *
+ * Inputs : a pointer to the rx queue running the group
+ *          the slot, TAKEN by the caller
+ *          the TX ring of the fast path
+ *
+ */
+static void
+onvm_pkt_steal_run(struct thread_info *rx, FP_Steal_Slot *slot, struct rte_ring *tx_ring);
+
+
+/*
+ * Function to make sure no lent group of a flow is still out, before the
+ * owner acts on, lends or evicts it. A slot nobody took is run here, a slot
+ * a thief runs is waited for.
+ *
+ * Inputs : a pointer to the rx queue owning the flow
+ *          the FID of the flow
+ *          the TX ring of the fast path
+ *
+ */
+static void
+onvm_pkt_steal_settle(struct thread_info *rx, uint32_t FID, struct rte_ring *tx_ring);
+
+
+/*
+ * Function to pick the flow groups of a burst to lend, if the RX core is
+ * backlogged. Flows with a lent group still out are settled first. Pending
+ * flows, parked flows and groups carrying a TCP FIN/RST stay on the owner.
+ *
+ * Inputs : a pointer to the rx queue
+ *          the burst and its size
+ *          the group index of every packet and the groups
+ *          the snort sequence passed to the state action
+ *          the TX ring of the fast path
+ *
+ * Output : a mask of the slots being filled, published once the burst's
+ *          packets are in
+ *
+ */
+static unsigned
+onvm_pkt_steal_pick(struct thread_info *rx, struct rte_mbuf *pkts[], uint16_t rx_count, uint8_t group_of[],
+                    RX_Flow_Group groups[], uint16_t num_groups, int snort_seq, struct rte_ring *tx_ring);
+
+
+/*
+ * Function to split an RX burst into its flows. Packet headers are
+ * prefetched for the whole burst first, then packets with the same RSS hash
+ * and 5-tuple share a group.
+ *
+ * Inputs : the burst and its size
+ *          where to store the group index of every packet
+ *          the groups to fill
+ *
+ * Output : the number of groups
+ *
+ */
+static uint16_t
+onvm_pkt_group_flows(struct rte_mbuf *pkts[], uint16_t rx_count, uint8_t group_of[], RX_Flow_Group groups[]);
+
+
+/*
+ * Function to look up (or insert) the GMAT entry of a group. A full shard is
+ * reported through group->is_new == -ENOSPC unless reclaim is set, in which
+ * case a cold flow is replaced first.
+ *
+ * Inputs : a pointer to the rx queue owning the shard
+ *          the group and its first packet
+ *          whether a full shard may be reclaimed from now
+ *          the ring fast path packets are handed to
+ *          where to add the number of packets sent to the NFs
+ *
+ */
+static void
+onvm_pkt_group_lookup(struct thread_info *rx, RX_Flow_Group *group, struct rte_mbuf *pkt,
+                      int reclaim, struct rte_ring *tx_ring, int *op_pkt_count);
+
+
+/*
+ * Function to refresh a group's GMAT entry for this burst: reference bit,
+ * last_seen and timer wheel link, then a snapshot of its flag and action.
+ *
+ * Inputs : a pointer to the rx queue owning the shard
+ *          the group
+ *
+ */
+static void
+onvm_pkt_group_touch(struct thread_info *rx, RX_Flow_Group *group);
+
+
+/*
+ * Function to send a packet of a pending flow to the first NF.
+ *
+ * Inputs : a pointer to the rx queue
+ *          a pointer to the packet
+ *
+ */
+inline static void
+onvm_pkt_op_action(struct thread_info *rx, struct rte_mbuf *pkt);
+
+
+/*
+ * Function to empty a flow's parking slot and give the slot back. Packets go
+ * out through the fast path if the flow is installed, to the NFs otherwise.
+ *
+ * Inputs : a pointer to the rx queue owning the slot
+ *          a pointer to the flow's GMAT entry
+ *          the ring fast path packets are handed to
+ *
+ * Output : the number of packets sent to the NFs
+ *
+ */
+static int
+onvm_pkt_park_release(struct thread_info *rx, MAT_Map *entry, struct rte_ring *tx_ring);
+
+
+/*
+ * Function to evict a flow from the GMAT shard of this rx queue. Parked
+ * packets are released first, the entry is unlinked from the timer wheel and
+ * GMAT_evict does the rest. If it fails the flow is retried on the next tick.
+ *
+ * Inputs : a pointer to the rx queue owning the flow
+ *          the FID of the flow and a pointer to its GMAT entry
+ *          the ring fast path packets are handed to
+ *          the eviction counter to bump on success
+ *
+ * Output : the number of packets sent to the NFs
+ *
+ */
+static int
+onvm_pkt_flow_evict(struct thread_info *rx, uint32_t FID, MAT_Map *entry, struct rte_ring *tx_ring, uint64_t *counter);
+
+
+/*
+ * Function to make room in a full GMAT shard. A CLOCK hand sweeps the shard,
+ * clearing the reference bit of recently hit flows and evicting the first one
+ * found without it, so hot flows keep their fast path and cold ones fall back
+ * to the slow path. Flows still pending consolidation or with parked packets
+ * are passed over, like the FIN path they are left to their timeout, so no
+ * LMAT reports are in flight for a FID handed to a new flow. At most
+ * FP_CLOCK_SCAN entries are looked at per call.
+ *
+ * Inputs : a pointer to the rx queue owning the shard
+ *          the ring fast path packets are handed to
+ *          where to add the number of packets sent to the NFs
+ *
+ * Output : 0 if a flow was evicted, -1 otherwise
+ *
+ */
+static int
+onvm_pkt_flow_reclaim(struct thread_info *rx, struct rte_ring *tx_ring, int *op_pkt_count);
+
+
+/*
+ * Function to handle a TCP FIN/RST. An installed flow is evicted at once, a
+ * pending one still has NF reports in flight so it is aged out FW_CLOSE_TICKS
+ * after its last packet instead.
+ *
+ * Inputs : a pointer to the rx queue owning the flow
+ *          the FID of the flow and a pointer to its GMAT entry
+ *          the ring fast path packets are handed to
+ *
+ * Output : the number of packets sent to the NFs
+ *
+ */
+static int
+onvm_pkt_flow_close(struct thread_info *rx, uint32_t FID, MAT_Map *entry, struct rte_ring *tx_ring);
+
+
+/*
+ * Helper function to check for a TCP FIN or RST.
+ *
+ * Input : a pointer to the packet
+ *
+ */
+inline static int
+onvm_pkt_is_fin_rst(struct rte_mbuf *pkt);
+
+
 /*
  * Helper function to drop a packet.
  *
@@ -172,141 +442,231 @@ onvm_pkt_drop(struct rte_mbuf *pkt);
 void
 onvm_pkt_process_rx_batch(struct thread_info *rx, struct rte_mbuf *pkts[], uint16_t rx_count, struct rte_ring *tx_ring) {
 
-		uint16_t i;
+		uint16_t i, g, num_groups;
         struct onvm_pkt_meta *meta;
-       
+		RX_Flow_Group groups[PACKET_READ_SIZE];
+		RX_Flow_Group *group;
+		uint8_t group_of[PACKET_READ_SIZE];
+		MAT_Map *entry;
+		Park_Slot *slot;
+		uint32_t hash_fid;
+		int is_new, closing;
 		int snort_seq;
-		void *bufs_fp[PACKET_READ_SIZE];
-		struct rte_mbuf *bufs_op[PACKET_READ_SIZE];
+		uint64_t tsc, t0, t1, t2, t3;
+		FP_Cycle_Stats *cyc;
+		struct rte_mbuf *bufs_fp[PACKET_READ_SIZE];
+		struct rte_mbuf *bufs_drop[PACKET_READ_SIZE];
 		int fp_pkt_count = 0;
+		int drop_count = 0;
 		int op_pkt_count = 0;
-		int op_pkt_lmat_update_con = 0;
-		int op_pkt_lmat_update_flag = 0;
+		int fp_ret;
+		unsigned lend = 0, s;
+		FP_Steal_Slot *lent;
 		
 		
         if (rx == NULL || pkts == NULL)
                 return;
-		Modify_FID(rx_count,pkts);
-		snort_seq = -1;
+		cyc = &fp_cycle_stats[rte_lcore_id()];
+		t0 = rte_rdtsc();
+		snort_seq = (int)lmat_chain.pkt_sa - 1;
+		num_groups = onvm_pkt_group_flows(pkts, rx_count, group_of, groups);
+		t1 = rte_rdtsc();
+
+		/* One GMAT lookup per flow, entries are prefetched while the next
+		 * flow is looked up. A full shard is only reclaimed once every flow
+		 * of the burst has its reference bit set, so none of them is the
+		 * CLOCK victim. */
+		for (g = 0; g < num_groups; g++)
+		{
+			onvm_pkt_group_lookup(rx, &groups[g], pkts[groups[g].first], 0, tx_ring, &op_pkt_count);
+			if (groups[g].entry != NULL)
+				rte_prefetch0(groups[g].entry);
+		}
+		for (g = 0; g < num_groups; g++)
+			onvm_pkt_group_touch(rx, &groups[g]);
+		for (g = 0; g < num_groups; g++)
+		{
+			if (unlikely(groups[g].is_new == -ENOSPC))
+			{
+				onvm_pkt_group_lookup(rx, &groups[g], pkts[groups[g].first], 1, tx_ring, &op_pkt_count);
+				onvm_pkt_group_touch(rx, &groups[g]);
+			}
+		}
+		/* Flow counters, once per flow and burst */
+		for (g = 0; g < num_groups; g++)
+		{
+			if (groups[g].entry != NULL)
+				fp_flow_count(groups[g].FID, groups[g].pkts, groups[g].bytes, t1);
+		}
+		if (fp_steal)
+			lend = onvm_pkt_steal_pick(rx, pkts, rx_count, group_of, groups, num_groups, snort_seq, tx_ring);
+		t2 = rte_rdtsc();
+
         for (i = 0; i < rx_count; i++) 
 		{
 			meta = (struct onvm_pkt_meta*) &(((struct rte_mbuf*)pkts[i])->udata64);
 			meta->src = 0;
 			meta->chain_index = 0;
-			//hash_fid = Get_FID(pkts,i);
-			hash_fid = NF_Get_FID_Chain(pkts[i]);
-			if(GMAT[hash_fid].flag == 0)
+			group = &groups[group_of[i]];
+			/* The flow was closed by an earlier packet of this burst */
+			if(unlikely(group->stale))
 			{
-				op_total_cont++;
-				int for_con3 = 0;
-				op_pkt_lmat_update_flag = 0;
-				for(; for_con3 < op_pkt_lmat_update_con; for_con3++)
-				{
-					if(op_hash[for_con3] == hash_fid)
-					{
-						op_pkt_lmat_update_flag = 1;
-						break;
-					}
-				}
-				if(op_pkt_lmat_update_flag == 0)
+				onvm_pkt_group_lookup(rx, group, pkts[i], 1, tx_ring, &op_pkt_count);
+				onvm_pkt_group_touch(rx, group);
+			}
+			hash_fid = group->FID;
+			entry = group->entry;
+			is_new = group->is_new;
+			group->is_new = 0;
+			onvm_get_fp_meta(pkts[i])->fid = hash_fid;
+			onvm_get_fp_meta(pkts[i])->gen = entry != NULL ? entry->gen : 0;
+			/* Lent whole, another RX core acts on it */
+			if(group->lent)
+			{
+				lent = &fp_steal_slots[rx->queue_id].slot[group->lent - 1];
+				lent->pkts[lent->count++] = pkts[i];
+				continue;
+			}
+			closing = entry != NULL && entry->tw_class == FW_CLASS_TCP && onvm_pkt_is_fin_rst(pkts[i]);
+			/* The flow already has packets waiting, keep its order */
+			if(entry != NULL && entry->park != 0)
+			{
+				slot = park_slot(rx->park, entry->park);
+				if(slot->count < PARK_DEPTH)
 				{
-					op_hash[op_pkt_lmat_update_con] = hash_fid;
-					op_pkt_lmat_update_con ++;
+					slot->pkts[slot->count++] = pkts[i];
+					if(closing)
+						op_pkt_count += onvm_pkt_flow_close(rx, hash_fid, entry, tx_ring);
+					group->stale = closing && !entry->in_use;
+					continue;
 				}
+				op_pkt_count += onvm_pkt_park_release(rx, entry, tx_ring);
+			}
+			if(entry == NULL || group->flag == 0)
+			{
 				op_pkt_count ++;
-				bufs_op[op_pkt_count] = pkts[i];
-				meta->action = ONVM_NF_ACTION_TONF;
-				meta->destination = 1;
-				(meta->chain_index)++;
-				onvm_pkt_enqueue_nf(rx, meta->destination, pkts[i]);
+				onvm_pkt_op_action(rx, pkts[i]);
+				/* Later packets of a new flow wait here for its GMAT entry */
+				if(is_new)
+					entry->park = park_slot_get(rx->park, hash_fid);
 			}
-			else{
-				fp_total_cont++;
+			else if(num_action_lcores)
+			{
+				onvm_pkt_pipe_stage(rx, hash_fid, &group->cpa, snort_seq, pkts[i]);
+			}
+			else if((fp_ret = onvm_pkt_fp_action(rx, hash_fid, &group->cpa, snort_seq, pkts[i])) > 0)
+			{
+				bufs_drop[drop_count++] = pkts[i];
+			}
+			else if(fp_ret == 0){
 				bufs_fp[fp_pkt_count] = pkts[i];
-				execute_GMAT_rule(hash_fid, cpa, snort_seq, pkts[i]);
-				if(cpa[3] != VALUE_NULL)
-				{
-					if(cpa[0]!=0)
-					{
-						Modify(S_IP,cpa[0],pkts,i);
-					}
-					if(cpa[1]!=0)
-					{
-						Modify(S_Port,cpa[1],pkts,i);
-					}
-					if(cpa[2]!=0)
-					{
-						Modify(D_IP,cpa[2],pkts,i);
-					}
-					if(cpa[3]!=0)
-					{
-						Modify(D_Port,cpa[3],pkts,i);
-					}
-				}
-				struct onvm_pkt_meta* meta;
-				meta = onvm_get_pkt_meta((struct rte_mbuf*)pkts[i]);
-				meta->destination = 1;
-				meta->action = ONVM_NF_ACTION_OUT;
 				fp_pkt_count ++;
 			}
-			
-		}
-		if(fp_pkt_count > 0)
-			rte_ring_enqueue_bulk(tx_ring, bufs_fp, fp_pkt_count);
-		if(op_pkt_lmat_update_con > 0)
-		{
-			int for_con1 = 0;
-			int op_complete_count = 0;
-			onvm_pkt_flush_all_nfs(rx);
-			while(1)
+			else{
+				op_pkt_count ++;
+			}
+			if(closing)
 			{
-				onvm_nf_check_LMAT();
-				for(for_con1 = 0;for_con1 < op_pkt_lmat_update_con;for_con1 ++)
-				{
-					if((OP_LMAT_bef_cons[op_hash[for_con1]][0] == NUM_OF_NF))
-					{
-						if((GMAT[op_hash[for_con1]].flag == 1))
-						{
-							op_complete_count ++;
-						}
-						else{
-							
-							/*--------------NF 1 Definition Begin-------------*/
-							LMAT_add_rule(LMAT[0], op_hash[for_con1], OP_LMAT_bef_cons[op_hash[for_con1]][1], OP_LMAT_bef_cons[op_hash[for_con1]][2], OP_LMAT_bef_cons[op_hash[for_con1]][3], NF1_state_action);
-							/*--------------NF 1 Definition End-------------*/
-							
-							/*--------------NF 2 Definition Begin-------------*/
-							//LMAT_add_rule(LMAT[1], op_hash[for_con1], OP_LMAT_bef_cons[op_hash[for_con1]][4], OP_LMAT_bef_cons[op_hash[for_con1]][5], OP_LMAT_bef_cons[op_hash[for_con1]][6], NF1_state_action);
-							/*--------------NF 2 Definition End-------------*/
-							
-							
-							/*--------------NF 3 Definition Begin-------------*/
-							//LMAT_add_rule(LMAT[2], op_hash[for_con1], OP_LMAT_bef_cons[op_hash[for_con1]][7], OP_LMAT_bef_cons[op_hash[for_con1]][8], OP_LMAT_bef_cons[op_hash[for_con1]][9], NF1_state_action);
-							/*--------------NF 3 Definition End-------------*/
-
-							
-							/*--------------GMAT: State Action Parallel Execution-------------*/
-							SA_parallel_execution(op_hash[for_con1], snort_seq, bufs_op[for_con1]);
-										
-							/*--------------GMAT: Packet Action Consolidation -------------*/
-							tmp_cpa = PA_consolidation(op_hash[for_con1]);
-							cpa[0] = tmp_cpa[0];
-							cpa[1] = tmp_cpa[1];
-							cpa[2] = tmp_cpa[2];
-							cpa[3] = tmp_cpa[3];
-							add_rule_to_GMAT(op_hash[for_con1], cpa);
-							op_complete_count ++;
-						}
-						if((op_complete_count == rx_count)||(op_complete_count == op_pkt_lmat_update_con))
-							break;
-					}
-				}
-				if(op_complete_count == op_pkt_lmat_update_con)
-				{
-					break;
-				}	
+				op_pkt_count += onvm_pkt_flow_close(rx, hash_fid, entry, tx_ring);
+				group->stale = !entry->in_use;
 			}
 		}
+		/* Metadata of the lent packets is written, publish their slots */
+		for (; lend; lend &= lend - 1)
+		{
+			s = __builtin_ctz(lend);
+			lent = &fp_steal_slots[rx->queue_id].slot[s];
+			fp_rx_stats[rx->queue_id].steal_lent += lent->count;
+			rte_smp_wmb();
+			lent->state = FP_STEAL_READY;
+			fp_steal_slots[rx->queue_id].out |= 1U << s;
+		}
+		t3 = rte_rdtsc();
+		if(fp_pkt_count > 0)
+			onvm_pkt_fp_send(rx, tx_ring, bufs_fp, fp_pkt_count);
+		/* Dropped flows never reach the TX ring */
+		if(drop_count > 0)
+			onvm_pkt_drop_batch(bufs_drop, drop_count);
+		/* New flows only need their first packets handed to the NFs, the
+		 * GMAT entry is installed by onvm_nf_check_LMAT once every NF has
+		 * reported, so the RX core goes straight back to polling the NIC. */
+		if(op_pkt_count > 0)
+			onvm_pkt_flush_all_nfs(rx);
+		tsc = rte_rdtsc();
+		cyc->cycles[FP_CYC_GROUP] += t1 - t0;
+		cyc->cycles[FP_CYC_LOOKUP] += t2 - t1;
+		cyc->cycles[FP_CYC_ACTION] += t3 - t2;
+		cyc->cycles[FP_CYC_ENQUEUE] += tsc - t3;
+		cyc->pkts += rx_count;
+}
+
+
+void
+onvm_pkt_park_poll(struct thread_info *rx, struct rte_ring *tx_ring) {
+        Park_Pool *pool;
+        Park_Slot *slot;
+        MAT_Map *entry;
+        uint64_t now;
+        uint16_t budget;
+        int op_pkt_count = 0;
+
+        if (rx == NULL || rx->park == NULL)
+                return;
+
+        pool = rx->park;
+        if (pool->active_count == 0)
+                return;
+
+        now = rte_get_timer_cycles();
+        for (budget = PARK_SCAN_BUDGET; budget > 0 && pool->active_count > 0; budget--) {
+                if (pool->scan >= pool->active_count)
+                        pool->scan = 0;
+                slot = park_slot(pool, pool->active[pool->scan]);
+                entry = GMAT_entry(slot->FID);
+                /* Releasing moves the last active slot into this position */
+                if (entry->flag == 1 || now > slot->deadline)
+                        op_pkt_count += onvm_pkt_park_release(rx, entry, tx_ring);
+                else
+                        pool->scan++;
+        }
+
+        if (op_pkt_count > 0)
+                onvm_pkt_flush_all_nfs(rx);
+}
+
+
+void
+onvm_pkt_flow_age_poll(struct thread_info *rx, struct rte_ring *tx_ring) {
+        Flow_Wheel *wheel;
+        MAT_Map *entry;
+        uint32_t FID, next, deadline;
+        uint16_t ticks;
+        int op_pkt_count = 0;
+
+        if (rx == NULL || rx->wheel == NULL)
+                return;
+
+        wheel = rx->wheel;
+        wheel->now = (rte_get_timer_cycles() - wheel->base) / wheel->tick_cycles;
+        for (ticks = 0; ticks < FW_TICKS_PER_POLL && (int32_t)(wheel->now - wheel->cur) >= 0; ticks++) {
+                FID = flow_wheel_take(wheel, wheel->cur);
+                while (FID != FID_NULL) {
+                        entry = GMAT_entry(FID);
+                        next = entry->tw_next;
+                        deadline = flow_deadline(wheel, entry);
+                        /* Packets since it was linked only moved last_seen, relink lazily */
+                        if ((int32_t)(deadline - wheel->cur) <= 0)
+                                op_pkt_count += onvm_pkt_flow_evict(rx, FID, entry, tx_ring,
+                                                                    &fp_rx_stats[rx->queue_id].evict_idle);
+                        else
+                                flow_wheel_link(wheel, FID, deadline);
+                        FID = next;
+                }
+                wheel->cur++;
+        }
+
+        if (op_pkt_count > 0)
+                onvm_pkt_flush_all_nfs(rx);
 }
 
 
@@ -375,6 +735,93 @@ onvm_pkt_drop_batch(struct rte_mbuf **pkts, uint16_t size) {
 }
 
 
+int
+onvm_pkt_pipeline_init(uint8_t rx_threads, uint8_t action_lcores) {
+        char name[RTE_RING_NAMESIZE];
+        unsigned r, a;
+
+        if (action_lcores == 0)
+                return 0;
+        /* Enough for full rings, full stages, the bursts being run and the lcore caches */
+        fp_desc_pool = rte_mempool_create(FP_PIPE_POOL_NAME,
+                        rx_threads * action_lcores * (FP_PIPE_RING_SIZE + FP_PIPE_BURST)
+                        + action_lcores * FP_PIPE_BURST + RTE_MAX_LCORE * FP_PIPE_BURST * 3 / 2,
+                        sizeof(struct fp_desc), FP_PIPE_BURST, 0, NULL, NULL, NULL, NULL, rte_socket_id(), NO_FLAGS);
+        if (fp_desc_pool == NULL)
+                return -1;
+        for (r = 0; r < rx_threads; r++) {
+                for (a = 0; a < action_lcores; a++) {
+                        snprintf(name, sizeof(name), FP_PIPE_RING_NAME, r, a);
+                        fp_pipe_ring[r][a] = rte_ring_create(name, FP_PIPE_RING_SIZE, rte_socket_id(),
+                                                             RING_F_SP_ENQ | RING_F_SC_DEQ);
+                        if (fp_pipe_ring[r][a] == NULL)
+                                return -1;
+                }
+        }
+        return 0;
+}
+
+
+void
+onvm_pkt_pipe_flush(struct thread_info *rx) {
+        FP_Pipe_Stage *stage;
+        unsigned a;
+
+        if (rx == NULL || num_action_lcores == 0)
+                return;
+
+        stage = &fp_pipe_stage[rx->queue_id];
+        for (a = 0; a < num_action_lcores; a++) {
+                if (stage->count[a] != 0)
+                        onvm_pkt_pipe_stage_flush(rx->queue_id, a);
+        }
+}
+
+
+void
+onvm_pkt_process_action(struct thread_info *act, struct rte_ring *tx_ring) {
+        struct fp_desc *desc[FP_PIPE_BURST];
+        struct rte_mbuf *bufs_fp[FP_PIPE_BURST];
+        struct rte_mbuf *bufs_drop[FP_PIPE_BURST];
+        FP_Cycle_Stats *cyc = &fp_cycle_stats[rte_lcore_id()];
+        unsigned col = act->queue_id - num_rx_threads;
+        unsigned r, i, n, out, drop, slow = 0;
+        uint64_t t0, t1, t2;
+        int ret;
+
+        for (r = 0; r < num_rx_threads; r++) {
+                t0 = rte_rdtsc();
+                n = rte_ring_sc_dequeue_burst(fp_pipe_ring[r][col], (void **)desc, FP_PIPE_BURST);
+                if (n == 0)
+                        continue;
+                out = drop = 0;
+                for (i = 0; i < n; i++) {
+                        if (i + 1 < n)
+                                rte_prefetch0(rte_pktmbuf_mtod(desc[i + 1]->pkt, void *));
+                        ret = onvm_pkt_fp_action(act, desc[i]->FID, &desc[i]->cpa, desc[i]->snort_seq, desc[i]->pkt);
+                        if (ret > 0)
+                                bufs_drop[drop++] = desc[i]->pkt;
+                        else if (ret == 0)
+                                bufs_fp[out++] = desc[i]->pkt;
+                        else
+                                slow++;
+                }
+                rte_mempool_put_bulk(fp_desc_pool, (void **)desc, n);
+                t1 = rte_rdtsc();
+                if (out > 0)
+                        onvm_pkt_fp_send(act, tx_ring, bufs_fp, out);
+                if (drop > 0)
+                        onvm_pkt_drop_batch(bufs_drop, drop);
+                t2 = rte_rdtsc();
+                cyc->cycles[FP_CYC_ACTION] += t1 - t0;
+                cyc->cycles[FP_CYC_ENQUEUE] += t2 - t1;
+                cyc->pkts += n;
+        }
+        if (slow > 0)
+                onvm_pkt_flush_all_nfs(act);
+}
+
+
 /****************************Internal functions*******************************/
 
 
@@ -391,7 +838,7 @@ onvm_pkt_flush_port_queue(struct thread_info *tx, uint16_t port) {
 
         tx_stats = &(ports->tx_stats);
         sent = rte_eth_tx_burst(port,
-                                tx->queue_id,
+                                tx->port_queue_id,
                                 tx->port_tx_buf[port].buffer,
                                 tx->port_tx_buf[port].count);
         if (unlikely(sent < tx->port_tx_buf[port].count)) {
@@ -522,9 +969,442 @@ onvm_pkt_process_next_action(struct thread_info *tx, struct rte_mbuf *pkt, struc
 }
 
 
+inline static int
+onvm_pkt_fp_action(struct thread_info *rx, uint32_t FID, FP_CPA *cpa, int snort_seq, struct rte_mbuf *pkt) {
+		struct onvm_pkt_meta *meta;
+		uint32_t gen = onvm_get_fp_meta(pkt)->gen;
+
+		fp_rx_stats[rx->queue_id].fp_total_cont++;
+		onvm_get_fp_meta(pkt)->path = ONVM_FP_PATH_FAST;
+		if(num_sa_workers){
+			/* The verdict of fired update rules applies from the flow's next packets on */
+			SA_dispatch(rx->queue_id, FID, gen, snort_seq, pkt, cpa->urt);
+		}else{
+			/* Action cores and thieves may act after the owning RX core evicted
+			 * the flow, the FID's state is another flow's then */
+			if(likely(GMAT_entry(FID)->gen == gen))
+				SA_parallel_execution(FID, snort_seq, pkt);
+			/* An action core's copy may outlive the flow's entry, its next packets get the verdict */
+			if(unlikely(cpa->urt) && check_URT(FID, gen) > 0 && rx->queue_id < num_rx_threads)
+				MAT_read_CPA(GMAT_entry(FID), cpa);
+		}
+		if(cpa->action == ACTION_DROP){
+			fp_rx_stats[rx->queue_id].fp_drop[pkt->port]++;
+			return 1;
+		}
+		/* An update rule may have just made the flow ACTION_SLOW, the NFs take the packet */
+		if(unlikely(cpa->action == ACTION_SLOW)){
+			fp_rx_stats[rx->queue_id].fp_total_cont--;//counted as a slow path packet instead
+			onvm_pkt_op_action(rx, pkt);
+			return -1;
+		}
+		if(cpa->action == ACTION_MODIFY && unlikely(fp_execute(pkt, cpa) != 0)){
+			fp_rx_stats[rx->queue_id].tunnel_err++;
+			return 1;
+		}
+		meta = onvm_get_pkt_meta(pkt);
+		meta->destination = cpa->port;
+		meta->action = ONVM_NF_ACTION_OUT;
+		return 0;
+}
+
+
+static void
+onvm_pkt_fp_send(struct thread_info *rx, struct rte_ring *tx_ring, struct rte_mbuf *pkts[], uint16_t count) {
+        uint16_t i;
+
+        if (rx->port_tx_buf != NULL) {
+                for (i = 0; i < count; i++)
+                        onvm_pkt_enqueue_port(rx, onvm_get_pkt_meta(pkts[i])->destination, pkts[i]);
+                return;
+        }
+        if (rte_ring_enqueue_bulk(tx_ring, (void **)pkts, count) != 0)
+                onvm_pkt_drop_batch(pkts, count);
+}
+
+
+static void
+onvm_pkt_pipe_stage(struct thread_info *rx, uint32_t FID, FP_CPA *cpa, int snort_seq, struct rte_mbuf *pkt) {
+        FP_Pipe_Stage *stage = &fp_pipe_stage[rx->queue_id];
+        unsigned act = FID % num_action_lcores;
+        struct fp_desc *desc;
+
+        if (unlikely(rte_mempool_get(fp_desc_pool, (void **)&desc) != 0)) {
+                /* Cannot happen with the pool sized as in onvm_pkt_pipeline_init */
+                fp_rx_stats[rx->queue_id].pipe_full++;
+                onvm_pkt_drop(pkt);
+                return;
+        }
+        desc->pkt = pkt;
+        desc->FID = FID;
+        desc->snort_seq = (int8_t)snort_seq;
+        desc->cpa = *cpa;
+        stage->desc[act][stage->count[act]++] = desc;
+        if (stage->count[act] == FP_PIPE_BURST)
+                onvm_pkt_pipe_stage_flush(rx->queue_id, act);
+}
+
+
+static void
+onvm_pkt_pipe_stage_flush(uint16_t rx_id, unsigned act) {
+        FP_Pipe_Stage *stage = &fp_pipe_stage[rx_id];
+        struct fp_desc **desc = stage->desc[act];
+        unsigned n = stage->count[act], done, i;
+
+        stage->count[act] = 0;
+        done = rte_ring_sp_enqueue_burst(fp_pipe_ring[rx_id][act], (void **)desc, n);
+        if (likely(done == n))
+                return;
+        /* The action core falls behind, drop like a full TX ring would */
+        for (i = done; i < n; i++)
+                onvm_pkt_drop(desc[i]->pkt);
+        rte_mempool_put_bulk(fp_desc_pool, (void **)desc + done, n - done);
+        fp_rx_stats[rx_id].pipe_full += n - done;
+}
+
+
+static void
+onvm_pkt_steal_run(struct thread_info *rx, FP_Steal_Slot *slot, struct rte_ring *tx_ring) {
+        struct rte_mbuf *drops[PACKET_READ_SIZE];
+        uint16_t i, out = 0, drop = 0, slow = 0;
+        int ret;
+
+        for (i = 0; i < slot->count; i++) {
+                ret = onvm_pkt_fp_action(rx, slot->FID, &slot->cpa, slot->snort_seq, slot->pkts[i]);
+                if (ret > 0)
+                        drops[drop++] = slot->pkts[i];
+                else if (ret == 0)
+                        slot->pkts[out++] = slot->pkts[i];
+                else
+                        slow++;
+        }
+        if (out > 0)
+                onvm_pkt_fp_send(rx, tx_ring, slot->pkts, out);
+        if (drop > 0)
+                onvm_pkt_drop_batch(drops, drop);
+        if (slow > 0)
+                onvm_pkt_flush_all_nfs(rx);
+        /* The packets are on the TX ring and the slot read before the owner may reuse it */
+        rte_smp_mb();
+        slot->state = FP_STEAL_FREE;
+}
+
+
+static void
+onvm_pkt_steal_settle(struct thread_info *rx, uint32_t FID, struct rte_ring *tx_ring) {
+        FP_Steal *steal = &fp_steal_slots[rx->queue_id];
+        FP_Steal_Slot *slot;
+        unsigned out, s;
+
+        for (out = steal->out; out; out &= out - 1) {
+                s = __builtin_ctz(out);
+                slot = &steal->slot[s];
+                if (slot->state != FP_STEAL_FREE && slot->FID != FID)
+                        continue;
+                if (rte_atomic32_cmpset(&slot->state, FP_STEAL_READY, FP_STEAL_TAKEN)) {
+                        fp_rx_stats[rx->queue_id].steal_back += slot->count;
+                        onvm_pkt_steal_run(rx, slot, tx_ring);
+                }
+                while (slot->state != FP_STEAL_FREE) {
+                        fp_rx_stats[rx->queue_id].steal_wait++;
+                        rte_pause();
+                }
+                steal->out &= ~(1U << s);
+        }
+}
+
+
+static unsigned
+onvm_pkt_steal_pick(struct thread_info *rx, struct rte_mbuf *pkts[], uint16_t rx_count, uint8_t group_of[],
+                    RX_Flow_Group groups[], uint16_t num_groups, int snort_seq, struct rte_ring *tx_ring) {
+        FP_Steal *steal = &fp_steal_slots[rx->queue_id];
+        FP_Steal_Slot *slot;
+        RX_Flow_Group *group;
+        unsigned lend = 0, free_slots, s;
+        uint16_t g, i;
+
+        if (rx_count == PACKET_READ_SIZE) {
+                if (steal->full < FP_STEAL_BURSTS)
+                        steal->full++;
+        } else {
+                steal->full = 0;
+        }
+        for (g = 0; g < num_groups && steal->out; g++) {
+                if (groups[g].entry != NULL)
+                        onvm_pkt_steal_settle(rx, groups[g].FID, tx_ring);
+        }
+        if (steal->full < FP_STEAL_BURSTS || num_rx_threads < 2)
+                return 0;
+
+        free_slots = ~(unsigned)steal->out & ((1U << FP_STEAL_SLOTS) - 1);
+        for (g = 0; g < num_groups && free_slots; g++) {
+                group = &groups[g];
+                if (group->entry == NULL || group->flag == 0 || group->is_new || group->entry->park != 0)
+                        continue;
+                s = __builtin_ctz(free_slots);
+                free_slots &= free_slots - 1;
+                group->lent = s + 1;
+                lend |= 1U << s;
+        }
+        if (lend == 0)
+                return 0;
+        /* The owner closes the flow after acting on a FIN/RST, so keep those groups */
+        for (i = 0; i < rx_count; i++) {
+                group = &groups[group_of[i]];
+                if (group->lent && group->entry->tw_class == FW_CLASS_TCP && onvm_pkt_is_fin_rst(pkts[i])) {
+                        lend &= ~(1U << (group->lent - 1));
+                        group->lent = 0;
+                }
+        }
+        for (g = 0; g < num_groups; g++) {
+                group = &groups[g];
+                if (!group->lent)
+                        continue;
+                slot = &steal->slot[group->lent - 1];
+                slot->FID = group->FID;
+                slot->count = 0;
+                slot->snort_seq = (int8_t)snort_seq;
+                slot->cpa = group->cpa;
+        }
+        return lend;
+}
+
+
+int
+onvm_pkt_steal(struct thread_info *rx, struct rte_ring *tx_ring) {
+        FP_Steal_Slot *slot;
+        unsigned r, s, done = 0;
+
+        if (rx == NULL)
+                return 0;
+
+        /* Start with the next core, so the idle cores spread over the busy ones */
+        for (r = 1; r < num_rx_threads; r++) {
+                for (s = 0; s < FP_STEAL_SLOTS; s++) {
+                        slot = &fp_steal_slots[(rx->queue_id + r) % num_rx_threads].slot[s];
+                        if (slot->state != FP_STEAL_READY
+                                        || !rte_atomic32_cmpset(&slot->state, FP_STEAL_READY, FP_STEAL_TAKEN))
+                                continue;
+                        done += slot->count;
+                        onvm_pkt_steal_run(rx, slot, tx_ring);
+                }
+        }
+        fp_rx_stats[rx->queue_id].steal_run += done;
+        return done;
+}
+
+
+static uint16_t
+onvm_pkt_group_flows(struct rte_mbuf *pkts[], uint16_t rx_count, uint8_t group_of[], RX_Flow_Group groups[]) {
+        uint8_t slots[FP_GROUP_SLOTS];
+        struct onvm_ft_ipv4_5tuple key;
+        RX_Flow_Group *group;
+        uint16_t i, num_groups = 0;
+        uint32_t s;
+        int keyed;
+
+        for (i = 0; i < rx_count; i++) {
+                rte_prefetch0(rte_pktmbuf_mtod(pkts[i], void *));
+                rte_prefetch0(onvm_get_fp_meta(pkts[i]));
+        }
+        memset(slots, 0xff, sizeof(slots));
+        for (i = 0; i < rx_count; i++) {
+                keyed = onvm_ft_fill_key(&key, pkts[i]) == 0;
+                if (likely(keyed)) {
+                        s = pkts[i]->hash.rss & (FP_GROUP_SLOTS - 1);
+                        while (slots[s] != 0xff) {
+                                group = &groups[slots[s]];
+                                if (group->rss == pkts[i]->hash.rss && fp_key_equal(&group->key, &key))
+                                        break;
+                                s = (s + 1) & (FP_GROUP_SLOTS - 1);
+                        }
+                        if (slots[s] != 0xff) {
+                                group_of[i] = slots[s];
+                                group->pkts++;
+                                group->bytes += rte_pktmbuf_pkt_len(pkts[i]);
+                                continue;
+                        }
+                        slots[s] = num_groups;
+                }
+                group = &groups[num_groups];
+                if (keyed)
+                        group->key = key;
+                group->rss = pkts[i]->hash.rss;
+                group->first = i;
+                group->keyed = keyed;
+                group->stale = 0;
+                group->lent = 0;
+                group->pkts = 1;
+                group->bytes = rte_pktmbuf_pkt_len(pkts[i]);
+                group_of[i] = num_groups++;
+        }
+        return num_groups;
+}
+
+
+static void
+onvm_pkt_group_lookup(struct thread_info *rx, RX_Flow_Group *group, struct rte_mbuf *pkt,
+                      int reclaim, struct rte_ring *tx_ring, int *op_pkt_count) {
+        group->FID = FID_NULL;
+        group->entry = NULL;
+        group->is_new = 0;
+        group->stale = 0;
+        if (!group->keyed)
+                return;
+
+        group->FID = GMAT_lookup_FID(rx->queue_id, pkt, &group->is_new);
+        /* Shard full, replace a cold flow or leave this one uncached */
+        if (unlikely(group->is_new == -ENOSPC) && reclaim) {
+                if (onvm_pkt_flow_reclaim(rx, tx_ring, op_pkt_count) == 0)
+                        group->FID = GMAT_lookup_FID(rx->queue_id, pkt, &group->is_new);
+                if (group->FID == FID_NULL) {
+                        fp_rx_stats[rx->queue_id].gmat_full++;
+                        group->is_new = 0;
+                }
+        }
+        if (group->FID != FID_NULL)
+                group->entry = GMAT_entry(group->FID);
+}
+
+
+static void
+onvm_pkt_group_touch(struct thread_info *rx, RX_Flow_Group *group) {
+        MAT_Map *entry = group->entry;
+
+        group->flag = 0;
+        if (entry == NULL)
+                return;
+        entry->last_seen = rx->wheel->now;
+        entry->ref = 1;
+        if (group->is_new)
+                flow_wheel_link(rx->wheel, group->FID, flow_deadline(rx->wheel, entry));
+        group->flag = MAT_read_CPA(entry, &group->cpa);
+}
+
+
+inline static void
+onvm_pkt_op_action(struct thread_info *rx, struct rte_mbuf *pkt) {
+		struct onvm_pkt_meta *meta = onvm_get_pkt_meta(pkt);
+
+		fp_rx_stats[rx->queue_id].op_total_cont++;
+		onvm_get_fp_meta(pkt)->path = ONVM_FP_PATH_SLOW;
+		meta->action = ONVM_NF_ACTION_TONF;
+		meta->destination = 1;
+		(meta->chain_index)++;
+		onvm_pkt_enqueue_nf(rx, meta->destination, pkt);
+}
+
+
+static int
+onvm_pkt_park_release(struct thread_info *rx, MAT_Map *entry, struct rte_ring *tx_ring) {
+        Park_Slot *slot = park_slot(rx->park, entry->park);
+        uint16_t i, count = slot->count, out = 0, drop = 0, slow = 0;
+        struct rte_mbuf *drops[PARK_DEPTH];
+        int ret;
+        FP_CPA cpa;
+        int fast = MAT_read_CPA(entry, &cpa);
+        /* Parked packets are inspected like any other fast path packet */
+        int snort_seq = (int)lmat_chain.pkt_sa - 1;
+
+        if (fast && num_action_lcores) {
+                /* Staged ahead of the flow's later packets, so they stay in order */
+                for (i = 0; i < count; i++)
+                        onvm_pkt_pipe_stage(rx, slot->FID, &cpa, snort_seq, slot->pkts[i]);
+                count = 0;
+        } else if (fast) {
+                for (i = 0; i < count; i++) {
+                        ret = onvm_pkt_fp_action(rx, slot->FID, &cpa, snort_seq, slot->pkts[i]);
+                        if (ret > 0)
+                                drops[drop++] = slot->pkts[i];
+                        else if (ret == 0)
+                                slot->pkts[out++] = slot->pkts[i];
+                        else
+                                slow++;
+                }
+                if (out > 0)
+                        onvm_pkt_fp_send(rx, tx_ring, slot->pkts, out);
+                if (drop > 0)
+                        onvm_pkt_drop_batch(drops, drop);
+                count = slow;
+        } else {
+                for (i = 0; i < count; i++)
+                        onvm_pkt_op_action(rx, slot->pkts[i]);
+        }
+
+        park_slot_put(rx->park, entry->park);
+        entry->park = 0;
+        return count;
+}
+
+
+static int
+onvm_pkt_flow_evict(struct thread_info *rx, uint32_t FID, MAT_Map *entry, struct rte_ring *tx_ring, uint64_t *counter) {
+        int op_pkt_count = 0;
+
+        if (fp_steal)
+                onvm_pkt_steal_settle(rx, FID, tx_ring);
+        if (entry->park != 0)
+                op_pkt_count = onvm_pkt_park_release(rx, entry, tx_ring);
+        flow_wheel_unlink(rx->wheel, FID);
+        if (GMAT_evict(FID) != 0)
+                flow_wheel_link(rx->wheel, FID, rx->wheel->now + 1);
+        else
+                (*counter)++;
+        return op_pkt_count;
+}
+
+
+static int
+onvm_pkt_flow_reclaim(struct thread_info *rx, struct rte_ring *tx_ring, int *op_pkt_count) {
+        Flow_Wheel *wheel = rx->wheel;
+        uint32_t mask = (1U << GMAT_shard_bits) - 1;
+        uint32_t FID;
+        uint16_t scanned;
+        MAT_Map *entry;
+
+        for (scanned = 0; scanned < FP_CLOCK_SCAN; scanned++) {
+                FID = ((uint32_t)rx->queue_id << GMAT_shard_bits) | wheel->hand;
+                wheel->hand = (wheel->hand + 1) & mask;
+                entry = GMAT_entry(FID);
+                if (!entry->in_use || entry->flag == 0 || entry->park != 0)
+                        continue;
+                if (entry->ref) {
+                        entry->ref = 0;
+                        continue;
+                }
+                *op_pkt_count += onvm_pkt_flow_evict(rx, FID, entry, tx_ring,
+                                                     &fp_rx_stats[rx->queue_id].evict_clock);
+                if (!entry->in_use)
+                        return 0;
+        }
+        return -1;
+}
+
+
+static int
+onvm_pkt_flow_close(struct thread_info *rx, uint32_t FID, MAT_Map *entry, struct rte_ring *tx_ring) {
+        if (entry->flag == 1)
+                return onvm_pkt_flow_evict(rx, FID, entry, tx_ring,
+                                           &fp_rx_stats[rx->queue_id].evict_close);
+
+        entry->tw_class = FW_CLASS_CLOSING;
+        flow_wheel_unlink(rx->wheel, FID);
+        flow_wheel_link(rx->wheel, FID, flow_deadline(rx->wheel, entry));
+        return 0;
+}
+
+
 /*******************************Helper function*******************************/
 
 
+inline static int
+onvm_pkt_is_fin_rst(struct rte_mbuf *pkt) {
+        struct tcp_hdr *tcp = onvm_pkt_tcp_hdr(pkt);
+
+        return tcp != NULL && (tcp->tcp_flags & (FP_TCP_FIN | FP_TCP_RST));
+}
+
+
 static int
 onvm_pkt_drop(struct rte_mbuf *pkt) {
         rte_pktmbuf_free(pkt);
@@ -75,6 +75,32 @@ void
 onvm_pkt_process_rx_batch(struct thread_info *rx, struct rte_mbuf *pkts[], uint16_t rx_count, struct rte_ring *tx_ring);
 /*FP End*/
 
+
+/*
+ * Interface to release the packets parked by an RX thread. Flows whose GMAT
+ * entry got installed are sent out through the fast path in arrival order,
+ * flows that waited longer than PARK_TIMEOUT_US go through the NFs instead.
+ *
+ * Inputs : a pointer to the rx queue
+ *          the ring fast path packets are handed to
+ *
+ */
+void
+onvm_pkt_park_poll(struct thread_info *rx, struct rte_ring *tx_ring);
+
+
+/*
+ * Interface to age the flows of an RX thread's GMAT shard. Expires the timer
+ * wheel buckets that came due since the last call and evicts the flows that
+ * stayed idle longer than their protocol's timeout.
+ *
+ * Inputs : a pointer to the rx queue
+ *          the ring fast path packets are handed to
+ *
+ */
+void
+onvm_pkt_flow_age_poll(struct thread_info *rx, struct rte_ring *tx_ring);
+
 /*
  * Interface to process packets in a given TX queue.
  *
@@ -119,4 +145,55 @@ void
 onvm_pkt_drop_batch(struct rte_mbuf **pkts, uint16_t size);
 
 
+/*
+ * Interface to create the descriptor pool and the rings from every RX thread
+ * to every action core of the pipeline. Does nothing without action cores.
+ *
+ * Inputs : the number of RX threads
+ *          the number of action cores
+ *
+ * Output : 0 on success, -1 otherwise
+ *
+ */
+int
+onvm_pkt_pipeline_init(uint8_t rx_threads, uint8_t action_lcores);
+
+
+/*
+ * Interface to hand the fast path packets an RX thread staged this round to
+ * the action cores.
+ *
+ * Input : a pointer to the rx queue
+ *
+ */
+void
+onvm_pkt_pipe_flush(struct thread_info *rx);
+
+
+/*
+ * Interface to run the fast path actions of the packets every RX thread
+ * queued for an action core, then send them out.
+ *
+ * Inputs : a pointer to the action core's thread info
+ *          the ring fast path packets are handed to
+ *
+ */
+void
+onvm_pkt_process_action(struct thread_info *act, struct rte_ring *tx_ring);
+
+
+/*
+ * Interface for an idle RX thread to run the flow groups the backlogged RX
+ * threads lent out.
+ *
+ * Inputs : a pointer to the rx queue
+ *          the ring fast path packets are handed to
+ *
+ * Output : the number of packets run
+ *
+ */
+int
+onvm_pkt_steal(struct thread_info *rx, struct rte_ring *tx_ring);
+
+
 #endif  // _ONVM_PKT_H_
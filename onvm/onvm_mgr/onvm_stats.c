@@ -57,12 +57,9 @@
 #include "fastpath_pkt.h"
 
 //#define MAX_NF_NUM 5
-extern int LMAT_bef_cons[(NUM_OF_NF + 1)][5];
 
 uint64_t nic_rx_pps_flag = 0;
 uint64_t nic_tx_pps_flag = 0;
-extern uint64_t fp_total_cont;
-extern uint64_t op_total_cont;
 
 /************************Internal Functions Prototypes************************/
 
@@ -85,6 +82,27 @@ static void
 onvm_stats_display_nfs(unsigned difftime);
 
 
+/*
+ * Function displaying the FP_TOP_FLOWS GMAT flows with the highest byte
+ * rate over the last period, the bytes they sent since the last display.
+ * Walks the flows in the GMAT shards, not every FID
+ *
+ * Input : time passed since last display
+ *
+ */
+static void
+onvm_stats_display_flows(unsigned difftime);
+
+
+/*
+ * Function displaying, per lcore, the cycles per packet each stage took
+ * since the last display
+ *
+ */
+static void
+onvm_stats_display_cycles(void);
+
+
 /*
  * Function clearing the terminal and moving back the cursor to the top left.
  *
@@ -177,6 +195,8 @@ onvm_stats_display_all(unsigned difftime) {
         }
 
         onvm_stats_display_ports(difftime);
+        onvm_stats_display_flows(difftime);
+        onvm_stats_display_cycles();
         onvm_stats_display_nfs(difftime);
 
         if (stats_out != stdout && stats_out != stderr) {
@@ -211,7 +231,16 @@ onvm_stats_clear_nf(uint16_t id) {
 
 static void
 onvm_stats_display_ports(unsigned difftime) {
-        unsigned i = 0;
+        unsigned i = 0, j;
+        uint64_t fp_total_cont, op_total_cont;
+        uint64_t gmat_used = 0, gmat_full = 0;
+        uint64_t evict_idle = 0, evict_close = 0, evict_clock = 0;
+        uint64_t sa_jobs = 0, sa_stall = 0, sa_inline = 0;
+        uint64_t tunnel_err = 0, pipe_full = 0;
+        uint64_t steal_lent = 0, steal_run = 0, steal_back = 0, steal_wait = 0;
+        uint64_t gmat_cap;
+        /* RX lcores' stats slots, then the action lcores' */
+        const unsigned fp_slots = num_rx_threads + num_action_lcores;
         uint64_t nic_rx_pkts = 0;
         uint64_t nic_tx_pkts = 0;
         uint64_t nic_rx_pps = 0;
@@ -221,6 +250,8 @@ onvm_stats_display_ports(unsigned difftime) {
         /* Arrays to store last TX/RX count to calculate rate */
         static uint64_t tx_last[RTE_MAX_ETHPORTS];
         static uint64_t rx_last[RTE_MAX_ETHPORTS];
+        static uint64_t fp_drop_last[RTE_MAX_ETHPORTS];
+        uint64_t fp_drop;
 
         fprintf(stats_out, "PORTS\n");
         fprintf(stats_out, "-----\n");
@@ -256,9 +287,20 @@ onvm_stats_display_ports(unsigned difftime) {
                                 nic_rx_pps,
                                 nic_tx_pkts,
                                 nic_tx_pps);
+                fp_drop = 0;
+                for (j = 0; j < fp_slots; j++)
+                        fp_drop += fp_rx_stats[j].fp_drop[ports->id[i]];
+                fprintf(stats_out, "Port %u - fast path drop: %9"PRIu64"  (%9"PRIu64" pps)\n",
+                                (unsigned)ports->id[i], fp_drop, (fp_drop - fp_drop_last[i]) / difftime);
+                fp_drop_last[i] = fp_drop;
 				
-				printf("fp_total_cont:%10ld\n",fp_total_cont);
-				printf("op_total_cont:%10ld\n",op_total_cont);
+				fp_total_cont = op_total_cont = 0;
+				for (j = 0; j < fp_slots; j++) {
+					fp_total_cont += fp_rx_stats[j].fp_total_cont;
+					op_total_cont += fp_rx_stats[j].op_total_cont;
+				}
+				printf("fp_total_cont:%10"PRIu64"\n",fp_total_cont);
+				printf("op_total_cont:%10"PRIu64"\n",op_total_cont);
 				
                 /* Only print this information out if we haven't already printed it to the console above */
                 if (stats_out != stdout && stats_out != stderr) {
@@ -277,7 +319,179 @@ onvm_stats_display_ports(unsigned difftime) {
                 rx_last[i] = nic_rx_pkts;
                 tx_last[i] = nic_tx_pkts;
         }
-		
+
+        /* Each RX thread owns one GMAT shard */
+        for (j = 0; j < fp_slots; j++) {
+                gmat_used += fp_rx_stats[j].gmat_used;
+                gmat_full += fp_rx_stats[j].gmat_full;
+                evict_idle += fp_rx_stats[j].evict_idle;
+                evict_close += fp_rx_stats[j].evict_close;
+                evict_clock += fp_rx_stats[j].evict_clock;
+                sa_jobs += fp_rx_stats[j].sa_jobs;
+                sa_stall += fp_rx_stats[j].sa_stall;
+                sa_inline += fp_rx_stats[j].sa_inline;
+                tunnel_err += fp_rx_stats[j].tunnel_err;
+                pipe_full += fp_rx_stats[j].pipe_full;
+                steal_lent += fp_rx_stats[j].steal_lent;
+                steal_run += fp_rx_stats[j].steal_run;
+                steal_back += fp_rx_stats[j].steal_back;
+                steal_wait += fp_rx_stats[j].steal_wait;
+        }
+        gmat_cap = (uint64_t)num_rx_threads << GMAT_shard_bits;
+        fprintf(stats_out, "GMAT - flows: %9"PRIu64" / %"PRIu64" (%3"PRIu64"%%)\t"
+                        "uncached: %9"PRIu64"\n",
+                        gmat_used, gmat_cap, gmat_used * 100 / gmat_cap, gmat_full);
+        fprintf(stats_out, "GMAT - evict idle: %9"PRIu64"  close: %9"PRIu64"  clock: %9"PRIu64"\n",
+                        evict_idle, evict_close, evict_clock);
+        if (num_sa_workers)
+                fprintf(stats_out, "SA workers - jobs: %9"PRIu64"  stalls: %9"PRIu64"  inline: %9"PRIu64"\n",
+                                sa_jobs, sa_stall, sa_inline);
+        if (tunnel_err)
+                fprintf(stats_out, "Tunnels - dropped: %9"PRIu64"\n", tunnel_err);
+        if (num_action_lcores)
+                fprintf(stats_out, "Pipeline - action cores: %u  ring full drops: %9"PRIu64"\n",
+                                (unsigned)num_action_lcores, pipe_full);
+        if (fp_steal)
+                fprintf(stats_out, "Stealing - lent: %9"PRIu64"  stolen: %9"PRIu64"  taken back: %9"PRIu64"  waits: %9"PRIu64"\n",
+                                steal_lent, steal_run, steal_back, steal_wait);
+}
+
+
+static void
+onvm_stats_display_flows(unsigned difftime) {
+        /* Counters of each FID at the last display, to rate the period only */
+        static struct {
+                uint64_t bytes;
+                uint64_t first_tsc;
+        } *last;
+        struct {
+                uint32_t FID;
+                uint64_t pkts, bytes;
+                uint64_t first_tsc;
+                uint64_t bps;
+        } top[FP_TOP_FLOWS];
+        struct onvm_ft_ipv4_5tuple key;
+        const void *hkey;
+        void *data;
+        const MAT_Map *entry;
+        const FP_Flow_Ctr *ctr;
+        const uint8_t *src, *dst;
+        cJSON *flow;
+        char *flow_label;
+        uint64_t pkts, bytes, first_tsc, bps;
+        uint32_t FID, cap, seq, next;
+        int32_t idx;
+        uint8_t in_use;
+        unsigned i, j, s, num_top = 0;
+
+        cap = (uint32_t)num_rx_threads << GMAT_shard_bits;
+        if (last == NULL) {
+                last = rte_zmalloc("fp flow rate", sizeof(*last) * cap, 0);
+                if (last == NULL)
+                        return;
+        }
+
+        /* Counters are aggregated only here, the RX cores just add to them. Only
+         * the flows in the shards' hash are visited, a slot the RX core frees
+         * meanwhile is caught by first_tsc below */
+        for (s = 0; s < num_rx_threads; s++) {
+                for (next = 0; (idx = onvm_ft_iterate(GMAT[s], &hkey, &data, &next)) >= 0;) {
+                        FID = ((uint32_t)s << GMAT_shard_bits) | (uint32_t)idx;
+                        ctr = GMAT_ctr(FID);
+                        pkts = ctr->pkts;
+                        bytes = ctr->bytes;
+                        first_tsc = ctr->first_tsc;
+                        /* A new flow in the FID, or one that started this period */
+                        if (pkts == 0 || first_tsc != last[FID].first_tsc)
+                                last[FID].bytes = 0;
+                        bps = bytes > last[FID].bytes ? (bytes - last[FID].bytes) * 8 / difftime : 0;
+                        last[FID].bytes = pkts ? bytes : 0;
+                        last[FID].first_tsc = pkts ? first_tsc : 0;
+                        if (bps == 0)
+                                continue;
+                        if (num_top == FP_TOP_FLOWS && bps <= top[num_top - 1].bps)
+                                continue;
+                        i = num_top < FP_TOP_FLOWS ? num_top++ : num_top - 1;
+                        for (; i > 0 && top[i - 1].bps < bps; i--)
+                                top[i] = top[i - 1];
+                        top[i].FID = FID;
+                        top[i].pkts = pkts;
+                        top[i].bytes = bytes;
+                        top[i].first_tsc = first_tsc;
+                        top[i].bps = bps;
+                }
+        }
+
+        fprintf(stats_out, "\nTOP FLOWS\n");
+        fprintf(stats_out, "-----\n");
+        for (j = 0; j < num_top; j++) {
+                /* The RX core may evict or reuse the FID meanwhile, skip it then */
+                entry = GMAT_entry(top[j].FID);
+                do {
+                        seq = fp_seq_read_begin(&entry->seq);
+                        key = entry->key;
+                        in_use = entry->in_use;
+                } while (fp_seq_read_retry(&entry->seq, seq));
+                if (!in_use || GMAT_ctr(top[j].FID)->first_tsc != top[j].first_tsc)
+                        continue;
+                src = (const uint8_t *)&key.src_addr;
+                dst = (const uint8_t *)&key.dst_addr;
+                ONVM_SNPRINTF(flow_label, 64, "%u.%u.%u.%u:%u > %u.%u.%u.%u:%u/%u",
+                        src[0], src[1], src[2], src[3], rte_be_to_cpu_16(key.src_port),
+                        dst[0], dst[1], dst[2], dst[3], rte_be_to_cpu_16(key.dst_port),
+                        key.proto);
+                fprintf(stats_out, "%-48s bps: %12"PRIu64"  pkts: %12"PRIu64"  bytes: %14"PRIu64"\n",
+                        flow_label, top[j].bps, top[j].pkts, top[j].bytes);
+
+                if (stats_out != stdout && stats_out != stderr) {
+                        cJSON_AddItemToArray(onvm_json_top_flows_arr, flow = cJSON_CreateObject());
+                        cJSON_AddStringToObject(flow, "Label", flow_label);
+                        cJSON_AddNumberToObject(flow, "FID", top[j].FID);
+                        cJSON_AddNumberToObject(flow, "BPS", top[j].bps);
+                        cJSON_AddNumberToObject(flow, "Packets", top[j].pkts);
+                        cJSON_AddNumberToObject(flow, "Bytes", top[j].bytes);
+                }
+                free(flow_label);
+        }
+}
+
+
+static void
+onvm_stats_display_cycles(void) {
+        static const char *stage_name[FP_NUM_CYC] = {
+                "group", "lookup", "action", "enqueue", "tx batch", "tx flush", "consolidate", "lmat wait(us)"
+        };
+        static FP_Cycle_Stats last[RTE_MAX_LCORE];
+        FP_Cycle_Stats now;
+        uint64_t pkts, flows, cycles, us_hz;
+        unsigned lcore, k;
+
+        us_hz = rte_get_tsc_hz() / 1000000;
+        fprintf(stats_out, "\nCYCLES (per packet, per installed flow for consolidation)\n");
+        fprintf(stats_out, "-----\n");
+        RTE_LCORE_FOREACH(lcore) {
+                now = fp_cycle_stats[lcore];
+                pkts = now.pkts - last[lcore].pkts;
+                flows = now.flows - last[lcore].flows;
+                if (pkts == 0 && flows == 0) {
+                        last[lcore] = now;
+                        continue;
+                }
+                fprintf(stats_out, "lcore %2u -", lcore);
+                for (k = 0; k < FP_NUM_CYC; k++) {
+                        cycles = now.cycles[k] - last[lcore].cycles[k];
+                        if (cycles == 0)
+                                continue;
+                        if (k == FP_CYC_LMAT_WAIT)
+                                fprintf(stats_out, "  %s: %"PRIu64, stage_name[k], cycles / us_hz / RTE_MAX(flows, 1));
+                        else if (k == FP_CYC_CONSOLIDATE)
+                                fprintf(stats_out, "  %s: %"PRIu64, stage_name[k], cycles / RTE_MAX(flows, 1));
+                        else
+                                fprintf(stats_out, "  %s: %"PRIu64, stage_name[k], cycles / RTE_MAX(pkts, 1));
+                }
+                fprintf(stats_out, "\n");
+                last[lcore] = now;
+        }
 }
 
 
@@ -431,4 +645,6 @@ onvm_json_reset_objects(void) {
                               onvm_json_port_stats_arr = cJSON_CreateArray());
         cJSON_AddItemToObject(onvm_json_root, ONVM_JSON_NF_STATS_KEY,
                               onvm_json_nf_stats_arr = cJSON_CreateArray());
+        cJSON_AddItemToObject(onvm_json_root, ONVM_JSON_TOP_FLOWS_KEY,
+                              onvm_json_top_flows_arr = cJSON_CreateArray());
 }
@@ -64,6 +64,7 @@
 
 #define ONVM_JSON_PORT_STATS_KEY "onvm_port_stats"
 #define ONVM_JSON_NF_STATS_KEY "onvm_nf_stats"
+#define ONVM_JSON_TOP_FLOWS_KEY "onvm_top_flows"
 #define ONVM_JSON_TIMESTAMP_KEY "last_updated"
 
 #define ONVM_SNPRINTF(str_, sz_, fmt_, ...)                                     \
@@ -85,6 +86,7 @@ typedef enum {
 cJSON* onvm_json_root;
 cJSON* onvm_json_port_stats_arr;
 cJSON* onvm_json_nf_stats_arr;
+cJSON* onvm_json_top_flows_arr;
 cJSON* onvm_json_port_stats[RTE_MAX_ETHPORTS];
 cJSON* onvm_json_nf_stats[MAX_NFS];
 
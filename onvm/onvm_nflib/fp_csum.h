@@ -0,0 +1,92 @@
+#ifndef _FP_CSUM_H_
+#define _FP_CSUM_H_
+
+#include <stddef.h>
+#include <string.h>
+
+#include <rte_mbuf.h>
+#include <rte_ether.h>
+#include <rte_ip.h>
+#include <rte_tcp.h>
+#include <rte_udp.h>
+
+/*
+ * RFC 1624 incremental checksum helpers shared by the manager's fast path
+ * rewrites and the NF side Modify, so both fix checksums the same way.
+ */
+
+/* Ones' complement sum of n bytes, n even, taken in memory order like the checksum */
+static inline uint32_t
+fp_csum_sum(const uint8_t *p, int n) {
+	uint32_t sum = 0;
+	uint16_t w;
+	int i;
+
+	for(i = 0;i < n;i += 2){
+		memcpy(&w, p + i, sizeof(w));
+		sum += w;
+	}
+	return sum;
+}
+
+static inline uint16_t
+fp_csum_fold(uint32_t sum) {
+	sum = (sum & 0xffff) + (sum >> 16);
+	return (sum & 0xffff) + (sum >> 16);
+}
+
+/* Delta of words summing to old replaced by words summing to upd, ~m + m' of RFC 1624 */
+static inline uint16_t
+fp_csum_delta(uint32_t old, uint32_t upd) {
+	return fp_csum_fold((uint16_t)~fp_csum_fold(old) + (uint32_t)fp_csum_fold(upd));
+}
+
+/* RFC 1624 eqn. 3: HC' = ~(~HC + D) */
+static inline uint16_t
+fp_csum_adjust(uint16_t hc, uint16_t d) {
+	return ~fp_csum_fold((uint16_t)~hc + (uint32_t)d);
+}
+
+/*
+ * Fixes the checksums of an IPv4 packet whose addresses/ports changed by
+ * d_ip/d_l4: the header checksum, or with offload the NIC fills it in, and
+ * the TCP/UDP checksum, which covers the addresses through the pseudo header.
+ * Non-first fragments have no L4 header, a UDP checksum of 0 means none.
+ */
+static inline void
+fp_csum_update(struct rte_mbuf *pkt, uint8_t *ip, uint16_t ihl, uint16_t d_ip, uint16_t d_l4, int offload) {
+	struct ipv4_hdr *h = (struct ipv4_hdr *)ip;
+	uint8_t *l4 = ip + ihl;
+	uint16_t c;
+
+	if(offload){
+		h->hdr_checksum = 0;
+		pkt->ol_flags |= PKT_TX_IPV4 | PKT_TX_IP_CKSUM;
+		pkt->l2_len = sizeof(struct ether_hdr);
+		pkt->l3_len = ihl;
+	}else{
+		h->hdr_checksum = fp_csum_adjust(h->hdr_checksum, d_ip);
+	}
+	if(h->fragment_offset & rte_cpu_to_be_16(IPV4_HDR_OFFSET_MASK))
+		return;
+	if(h->next_proto_id == IPPROTO_TCP
+			&& rte_pktmbuf_data_len(pkt) >= sizeof(struct ether_hdr) + ihl + sizeof(struct tcp_hdr)){
+		l4 += offsetof(struct tcp_hdr, cksum);
+		memcpy(&c, l4, sizeof(c));
+		c = fp_csum_adjust(c, d_l4);
+	}else if(h->next_proto_id == IPPROTO_UDP
+			&& rte_pktmbuf_data_len(pkt) >= sizeof(struct ether_hdr) + ihl + sizeof(struct udp_hdr)){
+		l4 += offsetof(struct udp_hdr, dgram_cksum);
+		memcpy(&c, l4, sizeof(c));
+		if(c == 0)
+			return;
+		c = fp_csum_adjust(c, d_l4);
+		if(c == 0)
+			c = 0xffff;
+	}else{
+		return;
+	}
+	memcpy(l4, &c, sizeof(c));
+}
+
+#endif  // _FP_CSUM_H_
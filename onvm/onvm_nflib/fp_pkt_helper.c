@@ -1,5 +1,6 @@
 #include "onvm_pkt_helper.h"
 #include "fp_pkt_helper.h"
+#include "fp_csum.h"
 #include "onvm_common.h"
 
 #include <inttypes.h>
@@ -32,36 +33,20 @@
  *
  ****************************************************************************/
  
+/*
+ * FID the manager stored in the mbuf's fast path metadata: the index of the
+ * flow's GMAT entry, or FID_NULL when the manager could not cache the flow.
+ * The packet data is not touched.
+ */
 uint32_t
 NF_Get_FID(struct rte_mbuf * bufs){
-	unsigned char * d = PktData(bufs);
-	uint32_t hash_fid = 0;
-	int i = 0;
-	hash_fid = hash_fid + *(d + 14 + 4);
-	for(i=1;i<4;i++)
-	{
-		
-//		printf("step_hash_fid:%d\n",hash_fid);
-		hash_fid = (hash_fid << 8) + *(d + 14 + 4 + i);
-	}
-	//printf("\nGet_FID:%d\n",hash_fid);
-	return hash_fid;
+	return onvm_get_fp_meta(bufs)->fid;
 }
+
+/* Same FID, kept for NFs written against the no fast path build */
 uint32_t
 NF_Get_FID_NOFP(struct rte_mbuf * bufs){
-	unsigned char * d = PktData(bufs);
-	uint32_t hash_fid = 0;
-	//int i = 0;
-	hash_fid = hash_fid + *(d + 14 + 22);
-	hash_fid = hash_fid * 256 + *(d + 14 + 23);
-	// for(i=1;i<4;i++)
-	// {
-		
-		// //printf("step_hash_fid:%d\n",hash_fid);
-		// hash_fid = (hash_fid << 8) + *(d + 14 + 20 + i);
-	// }
-	//printf("\nGet_FID:%d\n",hash_fid);
-	return hash_fid;
+	return onvm_get_fp_meta(bufs)->fid;
 }
 
 
@@ -243,6 +228,10 @@ Modify(unsigned short Field, int Value, struct rte_mbuf * pkt)
 {
 	unsigned short i;
 	unsigned char * d = PktData(pkt);
+	int is_ip = Field < 20 && Field > 10;
+	uint32_t old = fp_csum_sum(d + 14 + Field, is_ip ? 4 : 2);
+	uint16_t delta;
+
 	if(Field < 20 && Field >10)
 	{
 		for(i=0;i<4;i++)
@@ -260,21 +249,15 @@ Modify(unsigned short Field, int Value, struct rte_mbuf * pkt)
 		}
 
 	}
+	delta = fp_csum_delta(old, fp_csum_sum(d + 14 + Field, is_ip ? 4 : 2));
+	/* Ports are only in the TCP/UDP checksum, addresses in both */
+	fp_csum_update(pkt, d + 14, (d[14] & 0x0f) * 4, is_ip ? delta : 0, delta, 0);
 }
 
 unsigned int
 is_state_func(struct rte_mbuf * pkt)
 {
-	unsigned char * d = PktData(pkt);
-	d = d + 14;
-	if(((*d)&(uint8_t)128) == 128)
-	{
-		//*d = *d -128;
-		return 1;
-	}else
-	{
-		return 0;
-	}
+	return onvm_get_fp_meta(pkt)->path == ONVM_FP_PATH_STATE;
 }
 
 
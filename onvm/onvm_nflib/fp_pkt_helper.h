@@ -1,6 +1,8 @@
 #ifndef _FP_PKT_HELPER_
 #define _FP_PKT_HELPER_
 #include <stdint.h>
+
+#include "onvm_common.h"
 #define NUM_OF_ACTION 4
 #define ACTION_NULL -1
 #define ACTION_MODIFY 4
@@ -86,6 +88,7 @@ nat(struct rte_mbuf * bufs, nat_acl* acl);
 unsigned int
 ip_convert(unsigned char ip[4]);
 
+/* Rewrites the field at IPv4 header offset Field, updating the IPv4 and TCP/UDP checksums incrementally */
 void
 Modify(unsigned short Field, int Value, struct rte_mbuf * pkt);
 
@@ -83,6 +83,30 @@ static inline uint8_t onvm_get_pkt_chain_index(struct rte_mbuf* pkt) {
         return ((struct onvm_pkt_meta*)&pkt->udata64)->chain_index;
 }
 
+#define NUM_OF_FLOW (1 << 21) /* GMAT capacity, FID is the GMAT index of the flow's 5-tuple */
+#define FID_NULL 0xFFFFFFFF /* packet has no GMAT entry (non-IPv4 or GMAT full) */
+
+#define ONVM_FP_PATH_SLOW 0 /* packet goes through the NF chain */
+#define ONVM_FP_PATH_FAST 1 /* packet was handled by the manager's GMAT */
+#define ONVM_FP_PATH_STATE 2 /* packet only visits NFs to run their state functions */
+
+/*
+ * Fast path metadata, kept in the mbuf private area right after the rte_mbuf
+ * (the pool is created with mbuf_priv_size = ONVM_FP_META_SIZE) since
+ * onvm_pkt_meta already fills udata64. Written by the manager's RX threads.
+ */
+struct onvm_fp_meta {
+        uint32_t fid; /* GMAT FID of the packet's flow, FID_NULL if not cached */
+        uint32_t gen; /* generation of the FID, echoed in the NF's LMAT report */
+        uint8_t path; /* ONVM_FP_PATH_* */
+};
+
+#define ONVM_FP_META_SIZE RTE_ALIGN(sizeof(struct onvm_fp_meta), RTE_MBUF_PRIV_ALIGN)
+
+static inline struct onvm_fp_meta* onvm_get_fp_meta(struct rte_mbuf* pkt) {
+        return (struct onvm_fp_meta*)(pkt + 1);
+}
+
 /*
  * Shared port info, including statistics information for display by server.
  * Structure will be put in a memzone.
@@ -119,6 +143,8 @@ struct onvm_nf {
         struct rte_ring *rx_q;
         struct rte_ring *tx_q;
         struct rte_ring *msg_q;
+        /* FIDs of flows the manager evicted, see onvm_nflib_set_teardown_handler */
+        struct rte_ring *teardown_q;
         struct onvm_nf_info *info;
         uint16_t instance_id;
 
@@ -146,6 +172,15 @@ struct onvm_nf {
 
 };
 
+#define ONVM_SA_MODULE_LEN 128
+
+/*
+ * Symbols the manager binds from an NF's state action module, see
+ * SA_module_load. Either may be missing.
+ */
+#define ONVM_SA_SYMBOL "onvm_state_action"          /* void (*)(int FID) */
+#define ONVM_SA_PKT_SYMBOL "onvm_state_action_pkt"  /* void (*)(struct rte_mbuf *pkt) */
+
 /*
  * Define a structure to describe one NF
  */
@@ -154,6 +189,7 @@ struct onvm_nf_info {
         uint16_t service_id;
         uint8_t status;
         const char *tag;
+        char sa_module[ONVM_SA_MODULE_LEN]; /* shared object with the NF's state actions, "" if none */
 };
 
 /*
@@ -167,6 +203,32 @@ struct onvm_nf_LMAT{
 		int value;
 		int nf_id;
 		int state_func_flag;
+		int port; /* port the NF sent the packet out of, -1 if it passed it on */
+		uint32_t gen; /* onvm_fp_meta.gen of the packet, reports of an evicted flow are dropped */
+};
+
+#define ONVM_MAX_TUNNELS 64
+#define ONVM_TUNNEL_HDR_MAX 64
+
+/*
+ * Outer headers of a tunnel an NF originates or terminates, registered with
+ * onvm_nflib_tunnel_register. hdr is Ethernet, IPv4 without options, a UDP
+ * header if udp is set and the tunnel header, e.g. 50 bytes for VXLAN or 38
+ * for GRE. An ACTION_ENCAP/ACTION_DECAP LMAT report names it by its index.
+ */
+struct onvm_tunnel {
+        uint8_t hdr[ONVM_TUNNEL_HDR_MAX];
+        uint32_t ip_csum; /* ones' complement sum of the outer IPv4 header, total length and checksum as 0 */
+        uint8_t len;
+        uint8_t inner_l2; /* 1 if the inner packet keeps its Ethernet header (VXLAN), 0 if it starts at IP (GRE) */
+        uint8_t udp;
+        volatile uint8_t valid;
+};
+
+/* Shared in MZ_TUNNEL_INFO, templates are only ever added */
+struct onvm_tunnel_table {
+        rte_atomic32_t count; /* ids handed out, may pass ONVM_MAX_TUNNELS */
+        struct onvm_tunnel t[ONVM_MAX_TUNNELS];
 };
 
 /*
@@ -191,10 +253,12 @@ struct onvm_service_chain {
 #define MZ_NF_INFO "MProc_nf_info"
 #define MZ_SCP_INFO "MProc_scp_info"
 #define MZ_FTP_INFO "MProc_ftp_info"
+#define MZ_TUNNEL_INFO "MProc_tunnel_info"
 
 #define _MGR_LMAT_QUEUE_NAME "MGR_LMAT_QUEUE"
 #define _MGR_MSG_QUEUE_NAME "MSG_MSG_QUEUE"
 #define _NF_MSG_QUEUE_NAME "NF_%u_MSG_QUEUE"
+#define _NF_TEARDOWN_QUEUE_NAME "NF_%u_TEARDOWN_QUEUE"
 #define _NF_MEMPOOL_NAME "NF_INFO_MEMPOOL"
 #define _NF_LMAT_MEMPOOL_NAME "NF_LMAT_MEMPOOL"
 #define _NF_MSG_POOL_NAME "NF_MSG_MEMPOOL"
@@ -250,6 +314,17 @@ get_msg_queue_name(unsigned id) {
 
 }
 
+/*
+ * Given the name template above, get the mgr -> NF flow teardown queue name
+ */
+static inline const char *
+get_teardown_queue_name(unsigned id) {
+        static char buffer[sizeof(_NF_TEARDOWN_QUEUE_NAME) + 2];
+
+        snprintf(buffer, sizeof(buffer) - 1, _NF_TEARDOWN_QUEUE_NAME, id);
+        return buffer;
+}
+
 #define RTE_LOGTYPE_APP RTE_LOGTYPE_USER1
 
 #endif  // _COMMON_H_
@@ -86,6 +86,7 @@
 typedef int* (*pkt_handler)(struct rte_mbuf* pkt, struct onvm_pkt_meta* meta);
 /*FP End*/
 typedef int(*callback_handler)(void);
+typedef void(*flow_teardown_handler)(uint32_t fid);
 
 
 /******************************Global Variables*******************************/
@@ -102,6 +103,10 @@ static struct rte_ring *mgr_lmat_msg_queue;
 // ring used for mgr -> NF messages
 static struct rte_ring *nf_msg_ring;
 
+// ring of FIDs the mgr evicted, and what to call for each of them
+static struct rte_ring *nf_teardown_ring;
+static flow_teardown_handler teardown_handler = NULL;
+
 // rings used to pass packets between NFlib and NFmgr
 static struct rte_ring *tx_ring, *rx_ring;
 
@@ -129,6 +134,9 @@ static uint16_t initial_instance_id = NF_NO_ID;
 // User supplied service ID
 static uint16_t service_id = -1;
 
+// User supplied state action module, loaded by the manager
+static const char *sa_module = NULL;
+
 // True as long as the NF should keep processing packets
 static uint8_t keep_running = 1;
 
@@ -138,6 +146,9 @@ static uint8_t nf_mode = NF_MODE_UNKNOWN;
 // Shared data for default service chain
 static struct onvm_service_chain *default_chain;
 
+// Shared tunnel templates for ACTION_ENCAP/ACTION_DECAP
+static struct onvm_tunnel_table *tunnels;
+
 
 /***********************Internal Functions Prototypes*************************/
 
@@ -208,6 +219,12 @@ onvm_nflib_dequeue_packets(void **pkts, struct onvm_nf_info *info, pkt_handler h
 static inline void
 onvm_nflib_dequeue_messages(void) __attribute__((always_inline));
 
+/*
+ * Drain the FIDs of flows the manager evicted and pass them to the NF
+ */
+static inline void
+onvm_nflib_dequeue_teardowns(void) __attribute__((always_inline));
+
 /*
  * Set this NF's status to not running and release memory
  *
@@ -224,6 +241,7 @@ onvm_nflib_init(int argc, char *argv[], const char *nf_tag) {
         const struct rte_memzone *mz_nf;
         const struct rte_memzone *mz_port;
         const struct rte_memzone *mz_scp;
+        const struct rte_memzone *mz_tunnel;
         struct rte_mempool *mp;
         struct onvm_service_chain **scp;
         struct onvm_nf_msg *startup_msg;
@@ -292,6 +310,11 @@ onvm_nflib_init(int argc, char *argv[], const char *nf_tag) {
         scp = mz_scp->addr;
         default_chain = *scp;
 
+        mz_tunnel = rte_memzone_lookup(MZ_TUNNEL_INFO);
+        if (mz_tunnel == NULL)
+                rte_exit(EXIT_FAILURE, "Cannot get tunnel template info\n");
+        tunnels = mz_tunnel->addr;
+
         onvm_sc_print(default_chain);
 
         mgr_msg_queue = rte_ring_lookup(_MGR_MSG_QUEUE_NAME);
@@ -351,6 +374,10 @@ onvm_nflib_init(int argc, char *argv[], const char *nf_tag) {
         if (nf_msg_ring == NULL)
                 rte_exit(EXIT_FAILURE, "Cannot get nf msg ring");
 
+        nf_teardown_ring = rte_ring_lookup(get_teardown_queue_name(nf_info->instance_id));
+        if (nf_teardown_ring == NULL)
+                rte_exit(EXIT_FAILURE, "Cannot get nf teardown ring");
+
         /* Tell the manager we're ready to recieve packets */
         keep_running = 1;
 
@@ -390,6 +417,7 @@ onvm_nflib_run_callback(
         for (; keep_running;) {
                 onvm_nflib_dequeue_packets(pkts, info, handler);
                 onvm_nflib_dequeue_messages();
+                onvm_nflib_dequeue_teardowns();
                 if (callback != ONVM_NO_CALLBACK) {
                         keep_running = !(*callback)() && keep_running;
                 }
@@ -452,6 +480,47 @@ onvm_nflib_handle_msg(struct onvm_nf_msg *msg) {
         return 0;
 }
 
+void
+onvm_nflib_set_teardown_handler(flow_teardown_handler handler) {
+        teardown_handler = handler;
+}
+
+int
+onvm_nflib_tunnel_register(const void *hdr, uint8_t len, uint8_t inner_l2) {
+        const uint8_t *ip = (const uint8_t *)hdr + sizeof(struct ether_hdr);
+        struct onvm_tunnel *t;
+        uint32_t id, sum = 0;
+        uint16_t w;
+        uint8_t udp, i;
+
+        if (tunnels == NULL || hdr == NULL || len > ONVM_TUNNEL_HDR_MAX
+                        || len < sizeof(struct ether_hdr) + sizeof(struct ipv4_hdr) || ip[0] != 0x45)
+                return -1;
+        udp = ip[9] == IPPROTO_UDP;
+        if (udp && len < sizeof(struct ether_hdr) + sizeof(struct ipv4_hdr) + sizeof(struct udp_hdr))
+                return -1;
+
+        /* NFs register concurrently, the manager only reads valid templates */
+        id = rte_atomic32_add_return(&tunnels->count, 1) - 1;
+        if (id >= ONVM_MAX_TUNNELS)
+                return -1;
+        t = &tunnels->t[id];
+        memcpy(t->hdr, hdr, len);
+        memset(t->hdr + sizeof(struct ether_hdr) + offsetof(struct ipv4_hdr, total_length), 0, 2);
+        memset(t->hdr + sizeof(struct ether_hdr) + offsetof(struct ipv4_hdr, hdr_checksum), 0, 2);
+        for (i = 0; i < sizeof(struct ipv4_hdr); i += 2) {
+                memcpy(&w, t->hdr + sizeof(struct ether_hdr) + i, sizeof(w));
+                sum += w;
+        }
+        t->ip_csum = sum;
+        t->len = len;
+        t->inner_l2 = inner_l2 != 0;
+        t->udp = udp;
+        rte_wmb();
+        t->valid = 1;
+        return id;
+}
+
 void
 onvm_nflib_stop(void) {
         onvm_nflib_cleanup();
@@ -521,6 +590,7 @@ onvm_nflib_dequeue_packets(void **pkts, struct onvm_nf_info *info, pkt_handler h
 		rte_mempool_get_bulk(nf_LMAT_pool,LMAT_op_msg,nb_pkts);
         for (i = 0; i < nb_pkts; i++) {
 			meta = onvm_get_pkt_meta((struct rte_mbuf*)pkts[i]);
+			((struct onvm_nf_LMAT *)LMAT_op_msg[i])->gen = onvm_get_fp_meta((struct rte_mbuf*)pkts[i])->gen;
 			LMAT = (*handler)((struct rte_mbuf*)pkts[i], meta);
 			pktsTX[tx_batch_size++] = pkts[i];
 			((struct onvm_nf_LMAT *)LMAT_op_msg[i])->hash = LMAT[0];
@@ -529,6 +599,8 @@ onvm_nflib_dequeue_packets(void **pkts, struct onvm_nf_info *info, pkt_handler h
 			((struct onvm_nf_LMAT *)LMAT_op_msg[i])->value = LMAT[3];
 			((struct onvm_nf_LMAT *)LMAT_op_msg[i])->state_func_flag = LMAT[4];
 			((struct onvm_nf_LMAT *)LMAT_op_msg[i])->nf_id = LMAT[5];
+			((struct onvm_nf_LMAT *)LMAT_op_msg[i])->port =
+					meta->action == ONVM_NF_ACTION_OUT ? meta->destination : -1;
 			
         }
 		rte_ring_enqueue_bulk(mgr_lmat_msg_queue, LMAT_op_msg, nb_pkts);
@@ -555,6 +627,22 @@ onvm_nflib_dequeue_messages(void) {
         rte_mempool_put(nf_msg_pool, (void*)msg);
 }
 
+static inline void
+onvm_nflib_dequeue_teardowns(void) {
+        void *fids[PKT_READ_SIZE];
+        unsigned i, nb_fids;
+
+        if (likely(rte_ring_count(nf_teardown_ring) == 0)) {
+                return;
+        }
+        /* Drained even without a handler so the manager never sees it full */
+        nb_fids = rte_ring_dequeue_burst(nf_teardown_ring, fids, PKT_READ_SIZE);
+        if (teardown_handler == NULL)
+                return;
+        for (i = 0; i < nb_fids; i++)
+                (*teardown_handler)((uint32_t)(uintptr_t)fids[i]);
+}
+
 
 static struct onvm_nf_info *
 onvm_nflib_info_init(const char *tag)
@@ -575,6 +663,7 @@ onvm_nflib_info_init(const char *tag)
         info->service_id = service_id;
         info->status = NF_WAITING_FOR_ID;
         info->tag = tag;
+        snprintf(info->sa_module, sizeof(info->sa_module), "%s", sa_module == NULL ? "" : sa_module);
         return info;
 }
 
@@ -583,7 +672,8 @@ static void
 onvm_nflib_usage(const char *progname) {
         printf("Usage: %s [EAL args] -- "
                "[-n <instance_id>]"
-               "[-r <service_id>]\n\n", progname);
+               "[-r <service_id>]"
+               "[-m <state_action_module.so>]\n\n", progname);
 }
 
 
@@ -593,7 +683,7 @@ onvm_nflib_parse_args(int argc, char *argv[]) {
         int c;
 
         opterr = 0;
-        while ((c = getopt (argc, argv, "n:r:")) != -1)
+        while ((c = getopt (argc, argv, "n:r:m:")) != -1)
                 switch (c) {
                 case 'n':
                         initial_instance_id = (uint16_t) strtoul(optarg, NULL, 10);
@@ -603,9 +693,17 @@ onvm_nflib_parse_args(int argc, char *argv[]) {
                         // Service id 0 is reserved
                         if (service_id == 0) service_id = -1;
                         break;
+                case 'm':
+                        // Absolute path, the manager dlopens it from its own cwd
+                        sa_module = optarg;
+                        if (strlen(sa_module) >= ONVM_SA_MODULE_LEN) {
+                                fprintf(stderr, "State action module path longer than %d\n", ONVM_SA_MODULE_LEN - 1);
+                                return -1;
+                        }
+                        break;
                 case '?':
                         onvm_nflib_usage(progname);
-                        if (optopt == 'n')
+                        if (optopt == 'n' || optopt == 'm')
                                 fprintf(stderr, "Option -%c requires an argument.\n", optopt);
                         else if (isprint(optopt))
                                 fprintf(stderr, "Unknown option `-%c'.\n", optopt);
@@ -178,6 +178,37 @@ onvm_nflib_nf_ready(struct onvm_nf_info *info);
 int
 onvm_nflib_handle_msg(struct onvm_nf_msg *msg);
 
+/**
+ * Register the function called with the FID of every flow the manager
+ * evicts (idle timeout or TCP FIN/RST), so the NF can free its own state
+ * for that flow. The FID may be reused by a new flow afterwards.
+ *
+ * @param handler
+ *    the function to call, NULL to only drain the notifications
+ */
+void
+onvm_nflib_set_teardown_handler(void (*handler)(uint32_t fid));
+
+/**
+ * Register the outer headers of a tunnel the NF originates or terminates, so
+ * the manager can push or pop them on the fast path. Report ACTION_ENCAP or
+ * ACTION_DECAP with the returned id as the value to have a flow encapsulated
+ * or decapsulated. Templates live as long as the manager, register each once.
+ *
+ * @param hdr
+ *    Ethernet, IPv4 without options, for VXLAN a UDP header, and the tunnel
+ *    header, as they go on the wire. Lengths and checksums are filled in per packet.
+ * @param len
+ *    bytes of hdr, at most ONVM_TUNNEL_HDR_MAX
+ * @param inner_l2
+ *    1 if the tunnel carries the inner Ethernet header (VXLAN), 0 if it
+ *    starts at the inner IP header (GRE)
+ * @return
+ *    the tunnel id, or -1 if hdr is not such a header or the table is full
+ */
+int
+onvm_nflib_tunnel_register(const void *hdr, uint8_t len, uint8_t inner_l2);
+
 /**
  * Stop this NF and clean up its memory
  * Sends shutdown message to manager.